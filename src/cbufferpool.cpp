@@ -0,0 +1,405 @@
+#include "cbufferpool.h"
+#include "cchildboxes.h"
+
+void CLRUPolicy::inserted( const uint32_t id )
+{
+    order.push_front( id );
+    position[ id ] = order.begin();
+}
+
+void CLRUPolicy::accessed( const uint32_t id )
+{
+    order.splice( order.begin(), order, position.at( id ) );
+}
+
+void CLRUPolicy::erased( const uint32_t id )
+{
+    order.erase( position.at( id ) );
+    position.erase( id );
+}
+
+uint32_t CLRUPolicy::victim()
+{
+    uint32_t retval = order.back();
+    order.pop_back();
+    position.erase( retval );
+    return retval;
+}
+
+void CLRUPolicy::clear()
+{
+    order.clear();
+    position.clear();
+}
+
+CClockPolicy::CClockPolicy()
+    : hand( frames.end() )
+{}
+
+void CClockPolicy::inserted( const uint32_t id )
+{
+    // new frames are placed right behind the hand, so they are examined last
+    position[ id ] = frames.insert( hand, make_pair( id, false ) );
+}
+
+void CClockPolicy::accessed( const uint32_t id )
+{
+    position.at( id )->second = true;
+}
+
+void CClockPolicy::erased( const uint32_t id )
+{
+    auto it = position.at( id );
+    if( it == hand )
+        hand++;
+    frames.erase( it );
+    position.erase( id );
+}
+
+uint32_t CClockPolicy::victim()
+{
+    while( true )
+    {
+        if( hand == frames.end() )
+            hand = frames.begin();
+
+        if( ! hand->second )
+            break;
+
+        hand->second = false;
+        hand++;
+    }
+
+    uint32_t retval = hand->first;
+    position.erase( retval );
+    hand = frames.erase( hand );
+    return retval;
+}
+
+void CClockPolicy::clear()
+{
+    frames.clear();
+    position.clear();
+    hand = frames.end();
+}
+
+void C2QPolicy::inserted( const uint32_t id )
+{
+    auto ghost = ghosts.find( id );
+    if( ghost != ghosts.end() )
+    {
+        a1out.erase( ghost->second );
+        ghosts.erase( ghost );
+        am.push_front( id );
+        position[ id ] = make_pair( & am, am.begin() );
+    }
+    else
+    {
+        a1in.push_front( id );
+        position[ id ] = make_pair( & a1in, a1in.begin() );
+    }
+}
+
+void C2QPolicy::accessed( const uint32_t id )
+{
+    auto & pos = position.at( id );
+    if( pos.first == & am )
+        am.splice( am.begin(), am, pos.second );
+}
+
+void C2QPolicy::erased( const uint32_t id )
+{
+    auto & pos = position.at( id );
+    pos.first->erase( pos.second );
+    position.erase( id );
+}
+
+uint32_t C2QPolicy::victim()
+{
+    uint32_t retval;
+
+    // A1in takes up to a quarter of the resident nodes
+    if( am.empty() || 4 * a1in.size() > a1in.size() + am.size() )
+    {
+        retval = a1in.back();
+        a1in.pop_back();
+        remember( retval );
+    }
+    else
+    {
+        retval = am.back();
+        am.pop_back();
+    }
+
+    position.erase( retval );
+    return retval;
+}
+
+void C2QPolicy::remember( const uint32_t id )
+{
+    a1out.push_front( id );
+    ghosts[ id ] = a1out.begin();
+
+    // A1out remembers as many nodes as a half of the resident ones
+    while( a1out.size() > 1 && 2 * a1out.size() > position.size() )
+    {
+        ghosts.erase( a1out.back() );
+        a1out.pop_back();
+    }
+}
+
+void C2QPolicy::clear()
+{
+    a1in.clear();
+    a1out.clear();
+    am.clear();
+    position.clear();
+    ghosts.clear();
+}
+
+CBufferPool::CBufferPool( const size_t budget, const Policy policy )
+    : budget_( budget ), bytes_( 0 ), dirty_bytes( 0 ), hits_( 0 ), misses_( 0 ), evictions_( 0 )
+{
+    setPolicy( policy );
+}
+
+shared_ptr<CNode> CBufferPool::get( const uint32_t id )
+{
+    lock_guard<mutex> lock( mutex_ );
+    auto it = nodes.find( id );
+    if( it == nodes.end() )
+    {
+        misses_++;
+        return nullptr;
+    }
+
+    hits_++;
+    if( ! dirty.count( id ) )
+        replacement->accessed( id );
+    return it->second.first;
+}
+
+shared_ptr<CNode> CBufferPool::peek( const uint32_t id ) const
+{
+    lock_guard<mutex> lock( mutex_ );
+    auto it = nodes.find( id );
+    return it == nodes.end() ? nullptr : it->second.first;
+}
+
+void CBufferPool::put( const shared_ptr<CNode> & node, const bool dirty_node )
+{
+    lock_guard<mutex> lock( mutex_ );
+    size_t node_bytes = footprint( * node );
+    bool was_dirty = dirty.count( node->id() );
+
+    auto it = nodes.find( node->id() );
+    if( it != nodes.end() )
+    {
+        bytes_ -= it->second.second;
+        if( was_dirty )
+            dirty_bytes -= it->second.second;
+        it->second = make_pair( node, node_bytes );
+
+        if( ! was_dirty && dirty_node )
+            replacement->erased( node->id() );
+        else if( ! was_dirty )
+            replacement->accessed( node->id() );
+    }
+    else
+    {
+        nodes.emplace( node->id(), make_pair( node, node_bytes ) );
+        if( ! dirty_node )
+            replacement->inserted( node->id() );
+    }
+    bytes_ += node_bytes;
+
+    if( was_dirty || dirty_node )
+    {
+        dirty.insert( node->id() );
+        dirty_bytes += node_bytes;
+    }
+
+    evict();
+}
+
+void CBufferPool::erase( const uint32_t id )
+{
+    lock_guard<mutex> lock( mutex_ );
+    auto it = nodes.find( id );
+    if( it == nodes.end() )
+        return;
+
+    bytes_ -= it->second.second;
+    if( dirty.erase( id ) )
+        dirty_bytes -= it->second.second;
+    else
+        replacement->erased( id );
+    nodes.erase( it );
+}
+
+void CBufferPool::resized( const shared_ptr<CNode> & node )
+{
+    lock_guard<mutex> lock( mutex_ );
+    auto it = nodes.find( node->id() );
+    if( it == nodes.end() || it->second.first != node )
+        return;
+
+    const size_t node_bytes = footprint( * node );
+    bytes_ += node_bytes - it->second.second;
+    if( dirty.count( node->id() ) )
+        dirty_bytes += node_bytes - it->second.second;
+    it->second.second = node_bytes;
+
+    evict();
+}
+
+void CBufferPool::clear()
+{
+    lock_guard<mutex> lock( mutex_ );
+    nodes.clear();
+    replacement->clear();
+    bytes_ = 0;
+    dirty.clear();
+    dirty_bytes = 0;
+}
+
+void CBufferPool::setBudget( const size_t budget )
+{
+    lock_guard<mutex> lock( mutex_ );
+    budget_ = budget;
+    evict();
+}
+
+size_t CBufferPool::budget() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return budget_;
+}
+
+void CBufferPool::setPolicy( const Policy policy )
+{
+    lock_guard<mutex> lock( mutex_ );
+    policy_ = policy;
+
+    switch( policy )
+    {
+    case LRU:
+        replacement.reset( new CLRUPolicy() );
+        break;
+    case CLOCK:
+        replacement.reset( new CClockPolicy() );
+        break;
+    case TWO_Q:
+        replacement.reset( new C2QPolicy() );
+        break;
+    default:
+        throw logic_error( "Unknown replacement policy." );
+    }
+
+    for( const auto & node : nodes )
+        if( ! dirty.count( node.first ) )
+            replacement->inserted( node.first );
+}
+
+CBufferPool::Policy CBufferPool::policy() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return policy_;
+}
+
+size_t CBufferPool::size() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return nodes.size();
+}
+
+size_t CBufferPool::bytes() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return bytes_;
+}
+
+size_t CBufferPool::dirtyBytes() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return dirty_bytes;
+}
+
+vector<shared_ptr<CNode>> CBufferPool::dirtyNodes() const
+{
+    lock_guard<mutex> lock( mutex_ );
+
+    vector<uint32_t> ids( dirty.begin(), dirty.end() );
+    sort( ids.begin(), ids.end() );
+
+    vector<shared_ptr<CNode>> retval;
+    retval.reserve( ids.size() );
+    for( const uint32_t id : ids )
+        retval.push_back( nodes.at( id ).first );
+    return retval;
+}
+
+void CBufferPool::markClean()
+{
+    lock_guard<mutex> lock( mutex_ );
+
+    for( const uint32_t id : dirty )
+        replacement->inserted( id );
+    dirty.clear();
+    dirty_bytes = 0;
+
+    evict();
+}
+
+uint64_t CBufferPool::hits() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return hits_;
+}
+
+uint64_t CBufferPool::misses() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return misses_;
+}
+
+uint64_t CBufferPool::evictions() const
+{
+    lock_guard<mutex> lock( mutex_ );
+    return evictions_;
+}
+
+void CBufferPool::resetCounters()
+{
+    lock_guard<mutex> lock( mutex_ );
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+}
+
+size_t CBufferPool::footprint( const CNode & node )
+{
+    const shared_ptr<const CChildBoxes> child_boxes = node.child_boxes();
+    return sizeof( CNode ) + ( node.start().capacity() + node.dist().capacity() ) * sizeof( double )
+         + node.child_nodes_id().size() * ( sizeof( uint32_t ) + 2 * sizeof( void * ) )
+         + ( child_boxes ? child_boxes->bytes() : 0 );
+}
+
+size_t CBufferPool::footprint( const uint32_t dim, const uint32_t child_nodes )
+{
+    // the boxes are padded to a multiple of the SIMD lanes per dimension
+    const size_t stride = ( child_nodes + CChildBoxes::LANES - 1 ) / CChildBoxes::LANES * CChildBoxes::LANES;
+    return sizeof( CNode ) + 2 * dim * sizeof( double ) + child_nodes * ( sizeof( uint32_t ) + 2 * sizeof( void * ) )
+         + sizeof( CChildBoxes ) + 2 * dim * stride * sizeof( double ) + child_nodes * sizeof( uint32_t );
+}
+
+void CBufferPool::evict()
+{
+    while( bytes_ > budget_ && nodes.size() > dirty.size() )
+    {
+        auto it = nodes.find( replacement->victim() );
+        bytes_ -= it->second.second;
+        nodes.erase( it );
+        evictions_++;
+    }
+}
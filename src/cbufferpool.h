@@ -0,0 +1,188 @@
+#ifndef CBUFFERPOOL_H
+#define CBUFFERPOOL_H
+
+#include "cnode.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// decides which of the resident nodes leaves the buffer pool first
+class CReplacementPolicy
+{
+public:
+    virtual ~CReplacementPolicy() = default;
+
+    // the node became resident
+    virtual void inserted( const uint32_t id ) = 0;
+
+    // the resident node was hit
+    virtual void accessed( const uint32_t id ) = 0;
+
+    // the resident node was removed from the pool
+    virtual void erased( const uint32_t id ) = 0;
+
+    // picks and forgets the node to be evicted, there has to be at least one resident node
+    virtual uint32_t victim() = 0;
+
+    virtual void clear() = 0;
+};
+
+class CLRUPolicy : public CReplacementPolicy
+{
+public:
+    void inserted( const uint32_t id ) override;
+
+    void accessed( const uint32_t id ) override;
+
+    void erased( const uint32_t id ) override;
+
+    uint32_t victim() override;
+
+    void clear() override;
+
+private:
+    // most recently used first
+    list<uint32_t> order;
+    unordered_map<uint32_t, list<uint32_t>::iterator> position;
+};
+
+class CClockPolicy : public CReplacementPolicy
+{
+public:
+    CClockPolicy();
+
+    void inserted( const uint32_t id ) override;
+
+    void accessed( const uint32_t id ) override;
+
+    void erased( const uint32_t id ) override;
+
+    uint32_t victim() override;
+
+    void clear() override;
+
+private:
+    // id and reference bit, the hand moves towards the end and wraps around
+    list<pair<uint32_t, bool>> frames;
+    list<pair<uint32_t, bool>>::iterator hand;
+    unordered_map<uint32_t, list<pair<uint32_t, bool>>::iterator> position;
+};
+
+// simplified 2Q of Johnson and Shasha: nodes seen once stay in the FIFO A1in, nodes hit again
+// after they left A1in (remembered by A1out) are managed by the LRU Am
+class C2QPolicy : public CReplacementPolicy
+{
+public:
+    void inserted( const uint32_t id ) override;
+
+    void accessed( const uint32_t id ) override;
+
+    void erased( const uint32_t id ) override;
+
+    uint32_t victim() override;
+
+    void clear() override;
+
+private:
+    void remember( const uint32_t id );
+
+    list<uint32_t> a1in;
+    list<uint32_t> a1out;
+    list<uint32_t> am;
+    unordered_map<uint32_t, pair<list<uint32_t> *, list<uint32_t>::iterator>> position;
+    unordered_map<uint32_t, list<uint32_t>::iterator> ghosts;
+};
+
+// All the methods can be called concurrently. Dirty nodes (modified but not written yet) are
+// never evicted, they are left to the replacement policy only after they are marked clean.
+class CBufferPool
+{
+public:
+    enum Policy { LRU, CLOCK, TWO_Q };
+
+    CBufferPool( const size_t budget = 0, const Policy policy = LRU );
+
+    // returns nullptr if the node is not resident
+    shared_ptr<CNode> get( const uint32_t id );
+
+    // the same without counting it as an access
+    shared_ptr<CNode> peek( const uint32_t id ) const;
+
+    // inserts the node or replaces the resident node with the same id, a dirty node stays dirty
+    void put( const shared_ptr<CNode> & node, const bool dirty = false );
+
+    void erase( const uint32_t id );
+
+    // the child boxes of the node were attached or dropped, its footprint is recomputed if it is resident
+    void resized( const shared_ptr<CNode> & node );
+
+    void clear();
+
+    // budget in bytes of memory occupied by the resident nodes
+    void setBudget( const size_t budget );
+
+    size_t budget() const;
+
+    void setPolicy( const Policy policy );
+
+    Policy policy() const;
+
+    // number of resident nodes
+    size_t size() const;
+
+    // memory occupied by the resident nodes
+    size_t bytes() const;
+
+    // memory occupied by the dirty nodes
+    size_t dirtyBytes() const;
+
+    // the dirty nodes ordered by their ids
+    vector<shared_ptr<CNode>> dirtyNodes() const;
+
+    // all the dirty nodes were written
+    void markClean();
+
+    uint64_t hits() const;
+
+    uint64_t misses() const;
+
+    uint64_t evictions() const;
+
+    void resetCounters();
+
+    // estimated memory occupied by the node including its child boxes
+    static size_t footprint( const CNode & node );
+
+    // estimated memory occupied by an inner node with the given dimension and number of children and its child boxes
+    static size_t footprint( const uint32_t dim, const uint32_t child_nodes );
+
+private:
+    void evict();
+
+    mutable mutex mutex_;
+
+    size_t budget_;
+    Policy policy_;
+    unique_ptr<CReplacementPolicy> replacement;
+
+    unordered_map<uint32_t, pair<shared_ptr<CNode>, size_t>> nodes;
+    size_t bytes_;
+
+    unordered_set<uint32_t> dirty;
+    size_t dirty_bytes;
+
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+};
+
+#endif // CBUFFERPOOL_H
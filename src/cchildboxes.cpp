@@ -0,0 +1,239 @@
+#include "cchildboxes.h"
+
+#include <limits>
+
+#if defined( __AVX512F__ ) || defined( __AVX2__ )
+#include <immintrin.h>
+#endif
+
+CChildBoxes::CChildBoxes( const uint32_t dim, const uint32_t capacity, const bool data, const bool exact )
+    : dim( dim ), count( 0 ), stride( ( capacity + LANES - 1 ) / LANES * LANES ), data_( data ), exact_( exact ),
+      low( dim * stride, numeric_limits<double>::infinity() ),
+      high( dim * stride, - numeric_limits<double>::infinity() )
+{
+    ids.reserve( capacity );
+}
+
+void CChildBoxes::add( const uint32_t id, const CHyperrectangle & box )
+{
+    for( uint32_t axis = 0 ; axis < dim ; axis++ )
+    {
+        low[ axis * stride + count ] = box.start()[ axis ];
+        high[ axis * stride + count ] = box.start()[ axis ] + box.dist()[ axis ];
+    }
+    ids.push_back( id );
+    count++;
+}
+
+void CChildBoxes::add( const uint32_t id, const double * low, const double * high )
+{
+    for( uint32_t axis = 0 ; axis < dim ; axis++ )
+    {
+        this->low[ axis * stride + count ] = low[ axis ];
+        this->high[ axis * stride + count ] = high[ axis ];
+    }
+    ids.push_back( id );
+    count++;
+}
+
+uint32_t CChildBoxes::size() const { return count; }
+
+uint32_t CChildBoxes::id( const uint32_t i ) const { return ids[ i ]; }
+
+bool CChildBoxes::data() const { return data_; }
+
+bool CChildBoxes::exact() const { return exact_; }
+
+double CChildBoxes::lower( const uint32_t axis, const uint32_t i ) const { return low[ axis * stride + i ]; }
+
+double CChildBoxes::upper( const uint32_t axis, const uint32_t i ) const { return high[ axis * stride + i ]; }
+
+size_t CChildBoxes::bytes() const
+{
+    return sizeof( CChildBoxes ) + ( low.capacity() + high.capacity() ) * sizeof( double ) + ids.capacity() * sizeof( uint32_t );
+}
+
+void CChildBoxes::overlaps( const double * q_low, const double * q_high, vector<uint64_t> & mask ) const
+{
+    mask.assign( ( count + 63 ) / 64, 0 );
+
+#if defined( __AVX512F__ )
+    for( uint32_t i = 0 ; i < count ; i += 8 )
+    {
+        __mmask8 hit = 0xff;
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            hit = _mm512_mask_cmp_pd_mask( hit, _mm512_loadu_pd( & low[ axis * stride + i ] ), _mm512_set1_pd( q_high[ axis ] ), _CMP_LE_OQ );
+            hit = _mm512_mask_cmp_pd_mask( hit, _mm512_loadu_pd( & high[ axis * stride + i ] ), _mm512_set1_pd( q_low[ axis ] ), _CMP_GE_OQ );
+        }
+        mask[ i / 64 ] |= ( uint64_t ) hit << ( i % 64 );
+    }
+#elif defined( __AVX2__ )
+    for( uint32_t i = 0 ; i < count ; i += 4 )
+    {
+        __m256d hit = _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ) );
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            hit = _mm256_and_pd( hit, _mm256_cmp_pd( _mm256_loadu_pd( & low[ axis * stride + i ] ), _mm256_set1_pd( q_high[ axis ] ), _CMP_LE_OQ ) );
+            hit = _mm256_and_pd( hit, _mm256_cmp_pd( _mm256_loadu_pd( & high[ axis * stride + i ] ), _mm256_set1_pd( q_low[ axis ] ), _CMP_GE_OQ ) );
+        }
+        mask[ i / 64 ] |= ( uint64_t ) _mm256_movemask_pd( hit ) << ( i % 64 );
+    }
+#else
+    for( uint32_t i = 0 ; i < count ; i++ )
+    {
+        bool hit = true;
+        for( uint32_t axis = 0 ; axis < dim && hit ; axis++ )
+            hit = low[ axis * stride + i ] <= q_high[ axis ] && high[ axis * stride + i ] >= q_low[ axis ];
+        mask[ i / 64 ] |= ( uint64_t ) hit << ( i % 64 );
+    }
+#endif
+
+    clearPadding( mask );
+}
+
+void CChildBoxes::containedIn( const double * q_low, const double * q_high, vector<uint64_t> & mask ) const
+{
+    mask.assign( ( count + 63 ) / 64, 0 );
+
+#if defined( __AVX512F__ )
+    for( uint32_t i = 0 ; i < count ; i += 8 )
+    {
+        __mmask8 hit = 0xff;
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            hit = _mm512_mask_cmp_pd_mask( hit, _mm512_loadu_pd( & low[ axis * stride + i ] ), _mm512_set1_pd( q_low[ axis ] ), _CMP_GE_OQ );
+            hit = _mm512_mask_cmp_pd_mask( hit, _mm512_loadu_pd( & high[ axis * stride + i ] ), _mm512_set1_pd( q_high[ axis ] ), _CMP_LE_OQ );
+        }
+        mask[ i / 64 ] |= ( uint64_t ) hit << ( i % 64 );
+    }
+#elif defined( __AVX2__ )
+    for( uint32_t i = 0 ; i < count ; i += 4 )
+    {
+        __m256d hit = _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ) );
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            hit = _mm256_and_pd( hit, _mm256_cmp_pd( _mm256_loadu_pd( & low[ axis * stride + i ] ), _mm256_set1_pd( q_low[ axis ] ), _CMP_GE_OQ ) );
+            hit = _mm256_and_pd( hit, _mm256_cmp_pd( _mm256_loadu_pd( & high[ axis * stride + i ] ), _mm256_set1_pd( q_high[ axis ] ), _CMP_LE_OQ ) );
+        }
+        mask[ i / 64 ] |= ( uint64_t ) _mm256_movemask_pd( hit ) << ( i % 64 );
+    }
+#else
+    for( uint32_t i = 0 ; i < count ; i++ )
+    {
+        bool hit = true;
+        for( uint32_t axis = 0 ; axis < dim && hit ; axis++ )
+            hit = low[ axis * stride + i ] >= q_low[ axis ] && high[ axis * stride + i ] <= q_high[ axis ];
+        mask[ i / 64 ] |= ( uint64_t ) hit << ( i % 64 );
+    }
+#endif
+
+    clearPadding( mask );
+}
+
+void CChildBoxes::mindist( const double * point, double * out ) const
+{
+#if defined( __AVX512F__ ) || defined( __AVX2__ )
+    // the vectors are stored to a local buffer because out holds only count values
+    alignas( 64 ) double buffer[ 8 ];
+#endif
+
+#if defined( __AVX512F__ )
+    for( uint32_t i = 0 ; i < count ; i += 8 )
+    {
+        __m512d res = _mm512_setzero_pd();
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            __m512d p = _mm512_set1_pd( point[ axis ] );
+            __m512d r = _mm512_max_pd( _mm512_sub_pd( _mm512_loadu_pd( & low[ axis * stride + i ] ), p ),
+                                       _mm512_sub_pd( p, _mm512_loadu_pd( & high[ axis * stride + i ] ) ) );
+            r = _mm512_max_pd( r, _mm512_setzero_pd() );
+            res = _mm512_add_pd( res, _mm512_mul_pd( r, r ) );
+        }
+        _mm512_store_pd( buffer, res );
+        copy( buffer, buffer + min<uint32_t>( 8, count - i ), out + i );
+    }
+#elif defined( __AVX2__ )
+    for( uint32_t i = 0 ; i < count ; i += 4 )
+    {
+        __m256d res = _mm256_setzero_pd();
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            __m256d p = _mm256_set1_pd( point[ axis ] );
+            __m256d r = _mm256_max_pd( _mm256_sub_pd( _mm256_loadu_pd( & low[ axis * stride + i ] ), p ),
+                                       _mm256_sub_pd( p, _mm256_loadu_pd( & high[ axis * stride + i ] ) ) );
+            r = _mm256_max_pd( r, _mm256_setzero_pd() );
+            res = _mm256_add_pd( res, _mm256_mul_pd( r, r ) );
+        }
+        _mm256_store_pd( buffer, res );
+        copy( buffer, buffer + min<uint32_t>( 4, count - i ), out + i );
+    }
+#else
+    for( uint32_t i = 0 ; i < count ; i++ )
+    {
+        double res = 0;
+        double r;
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            r = max( max( low[ axis * stride + i ] - point[ axis ], point[ axis ] - high[ axis * stride + i ] ), 0.0 );
+            res += r * r;
+        }
+        out[ i ] = res;
+    }
+#endif
+}
+
+void CChildBoxes::closerThan( const double * point, const double max_mindist, vector<uint64_t> & mask ) const
+{
+    mask.assign( ( count + 63 ) / 64, 0 );
+
+#if defined( __AVX512F__ )
+    for( uint32_t i = 0 ; i < count ; i += 8 )
+    {
+        __m512d res = _mm512_setzero_pd();
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            __m512d p = _mm512_set1_pd( point[ axis ] );
+            __m512d r = _mm512_max_pd( _mm512_sub_pd( _mm512_loadu_pd( & low[ axis * stride + i ] ), p ),
+                                       _mm512_sub_pd( p, _mm512_loadu_pd( & high[ axis * stride + i ] ) ) );
+            r = _mm512_max_pd( r, _mm512_setzero_pd() );
+            res = _mm512_add_pd( res, _mm512_mul_pd( r, r ) );
+        }
+        mask[ i / 64 ] |= ( uint64_t ) _mm512_cmp_pd_mask( res, _mm512_set1_pd( max_mindist ), _CMP_LE_OQ ) << ( i % 64 );
+    }
+#elif defined( __AVX2__ )
+    for( uint32_t i = 0 ; i < count ; i += 4 )
+    {
+        __m256d res = _mm256_setzero_pd();
+        for( uint32_t axis = 0 ; axis < dim ; axis++ )
+        {
+            __m256d p = _mm256_set1_pd( point[ axis ] );
+            __m256d r = _mm256_max_pd( _mm256_sub_pd( _mm256_loadu_pd( & low[ axis * stride + i ] ), p ),
+                                       _mm256_sub_pd( p, _mm256_loadu_pd( & high[ axis * stride + i ] ) ) );
+            r = _mm256_max_pd( r, _mm256_setzero_pd() );
+            res = _mm256_add_pd( res, _mm256_mul_pd( r, r ) );
+        }
+        mask[ i / 64 ] |= ( uint64_t ) _mm256_movemask_pd( _mm256_cmp_pd( res, _mm256_set1_pd( max_mindist ), _CMP_LE_OQ ) ) << ( i % 64 );
+    }
+#else
+    for( uint32_t i = 0 ; i < count ; i++ )
+    {
+        double res = 0;
+        double r;
+        for( uint32_t axis = 0 ; axis < dim && res <= max_mindist ; axis++ )
+        {
+            r = max( max( low[ axis * stride + i ] - point[ axis ], point[ axis ] - high[ axis * stride + i ] ), 0.0 );
+            res += r * r;
+        }
+        mask[ i / 64 ] |= ( uint64_t )( res <= max_mindist ) << ( i % 64 );
+    }
+#endif
+
+    clearPadding( mask );
+}
+
+void CChildBoxes::clearPadding( vector<uint64_t> & mask ) const
+{
+    if( count % 64 )
+        mask.back() &= ( ( uint64_t ) 1 << ( count % 64 ) ) - 1;
+}
@@ -0,0 +1,84 @@
+#ifndef CCHILDBOXES_H
+#define CCHILDBOXES_H
+
+#include "chyperrectangle.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// MBRs of the children of an inner node stored as structure of arrays: the lower and upper
+// corners of all children are contiguous per dimension, so a query is tested against all
+// of them at once with SIMD instructions (AVX-512 or AVX2 if enabled at compile time).
+class CChildBoxes
+{
+public:
+    // data has to be true if the children are data nodes,
+    // exact is false if the boxes only enclose the MBRs of the children
+    CChildBoxes( const uint32_t dim, const uint32_t capacity, const bool data, const bool exact = true );
+
+    void add( const uint32_t id, const CHyperrectangle & box );
+
+    void add( const uint32_t id, const double * low, const double * high );
+
+    uint32_t size() const;
+
+    uint32_t id( const uint32_t i ) const;
+
+    bool data() const;
+
+    bool exact() const;
+
+    // the coordinates of the i-th box along the axis
+    double lower( const uint32_t axis, const uint32_t i ) const;
+
+    double upper( const uint32_t axis, const uint32_t i ) const;
+
+    // Bit i of the mask (word i / 64, bit i % 64) is set if the i-th box overlaps
+    // the hyperrectangle given by its lower and upper corners.
+    void overlaps( const double * low, const double * high, vector<uint64_t> & mask ) const;
+
+    // sets bit i of the mask if the i-th box lies within the hyperrectangle
+    void containedIn( const double * low, const double * high, vector<uint64_t> & mask ) const;
+
+    // out[i] is the squared distance of the point from the i-th box
+    void mindist( const double * point, double * out ) const;
+
+    // sets bit i of the mask if the squared distance of the point from the i-th box is at most max_mindist
+    void closerThan( const double * point, const double max_mindist, vector<uint64_t> & mask ) const;
+
+    // memory occupied by the boxes
+    size_t bytes() const;
+
+    // number of doubles per dimension, a multiple of the widest SIMD vector
+    static constexpr uint32_t LANES = 8;
+
+private:
+    void clearPadding( vector<uint64_t> & mask ) const;
+
+    uint32_t dim;
+    uint32_t count;
+    uint32_t stride;
+    bool data_;
+    bool exact_;
+
+    // low[axis * stride + i] is the lower coordinate of the i-th box
+    vector<double> low;
+    vector<double> high;
+    vector<uint32_t> ids;
+};
+
+// Calls f( i ) for every bit i set in the mask until f returns false.
+// Returns false if it was stopped.
+template <typename F>
+inline bool forEachBit( const vector<uint64_t> & mask, F f )
+{
+    for( size_t word = 0 ; word < mask.size() ; word++ )
+        for( uint64_t bits = mask[ word ] ; bits ; bits &= bits - 1 )
+            if( ! f( ( uint32_t )( word * 64 + __builtin_ctzll( bits ) ) ) )
+                return false;
+    return true;
+}
+
+#endif // CCHILDBOXES_H
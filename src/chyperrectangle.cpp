@@ -1,5 +1,7 @@
 #include "chyperrectangle.h"
 
+#include <cassert>
+
 
 CHyperrectangle::CHyperrectangle() {}
 
@@ -13,73 +15,77 @@ CHyperrectangle::CHyperrectangle( const vector<double> & start )
 
 bool CHyperrectangle::contains( const CHyperrectangle & other ) const
 {
-    for( unsigned i = 0 ; i < start_.size() ; i++ )
-        if( start_.at( i ) > other.start().at( i )
-            || start_.at( i ) + dist_.at( i ) < other.start().at( i ) + other.dist().at( i ) )
-        {
-            return false;
-        }
-    return true;
+    assert( start_.size() == other.start_.size() );
+    return dispatchDimension( start_.size(), [&]( auto geometry )
+    {
+        return geometry.contains( start_.data(), dist_.data(), other.start_.data(), other.dist_.data(), start_.size() );
+    } );
 }
 
 bool CHyperrectangle::overlaps( const CHyperrectangle & other ) const
 {
-    for( unsigned i = 0 ; i < start_.size() ; i++ )
-        if( start_.at( i ) + dist_.at( i ) < other.start().at( i )
-            || other.start().at( i ) + other.dist().at( i ) < start_.at( i ) )
-        {
-            return false;
-        }
-    return true;
+    assert( start_.size() == other.start_.size() );
+    return dispatchDimension( start_.size(), [&]( auto geometry )
+    {
+        return geometry.overlaps( start_.data(), dist_.data(), other.start_.data(), other.dist_.data(), start_.size() );
+    } );
 }
 
 void CHyperrectangle::merge( const CHyperrectangle & other )
 {
-    double end;
-    for( unsigned i = 0 ; i < start_.size() ; i++ )
+    assert( start_.size() == other.start_.size() );
+    dispatchDimension( start_.size(), [&]( auto geometry )
     {
-        end = max( start_.at( i ) + dist_.at( i ), other.start().at( i ) + other.dist().at( i ) );
-        start_.at( i ) = min( start_.at( i ), other.start().at( i ) );
-        dist_.at( i ) = abs( end - start_.at( i ) );
-    }
+        geometry.merge( start_.data(), dist_.data(), other.start_.data(), other.dist_.data(), start_.size() );
+    } );
 }
 
 double CHyperrectangle::enlargementWith( const CHyperrectangle & other ) const
 {
-    CHyperrectangle merged( * this );
-    merged.merge( other );
-    return merged.volume() - volume();
+    return mergedVolume( other ) - volume();
 }
 
 double CHyperrectangle::volume() const
 {
-    double volume = 1;
-    for( auto d : dist_ )
-        volume *= d;
-    return volume;
+    return dispatchDimension( dist_.size(), [&]( auto geometry )
+    {
+        return geometry.volume( dist_.data(), dist_.size() );
+    } );
 }
 
-double CHyperrectangle::mindist( const vector<double> & point )
+double CHyperrectangle::mergedVolume( const CHyperrectangle & other ) const
 {
-    double res = 0;
-    double r;
+    assert( start_.size() == other.start_.size() );
+    return dispatchDimension( start_.size(), [&]( auto geometry )
+    {
+        return geometry.mergedVolume( start_.data(), dist_.data(), other.start_.data(), other.dist_.data(), start_.size() );
+    } );
+}
 
-    for( unsigned i = 0; i < point.size(); i++ )
+double CHyperrectangle::overlapVolume( const CHyperrectangle & other ) const
+{
+    assert( start_.size() == other.start_.size() );
+    return dispatchDimension( start_.size(), [&]( auto geometry )
+    {
+        return geometry.overlapVolume( start_.data(), dist_.data(), other.start_.data(), other.dist_.data(), start_.size() );
+    } );
+}
+
+double CHyperrectangle::margin() const
+{
+    return dispatchDimension( dist_.size(), [&]( auto geometry )
+    {
+        return geometry.margin( dist_.data(), dist_.size() );
+    } );
+}
+
+double CHyperrectangle::mindist( const vector<double> & point ) const
+{
+    assert( start_.size() == point.size() );
+    return dispatchDimension( point.size(), [&]( auto geometry )
     {
-        if( point.at( i ) < start_.at( i ) )
-        {
-            r = start_.at( i );
-        }else if( point.at( i ) > start_.at( i ) + dist_.at( i ) )
-        {
-            r = start_.at( i ) + dist_.at( i );
-        }else
-        {
-            r = point.at( i );
-        }
-        res += pow( abs( point.at( i ) - r ), 2 );
-    }
-
-    return res;
+        return geometry.mindist( start_.data(), dist_.data(), point.data(), point.size() );
+    } );
 }
 
 vector<double> & CHyperrectangle::start() { return start_; }
@@ -4,13 +4,126 @@
 #include <vector>
 #include <list>
 #include <vector>
+#include <array>
 #include <string>
 #include <math.h>
+#include <algorithm>
 
 #include <iostream>
 
 using namespace std;
 
+// Geometry kernels working on raw coordinates without bounds checks and allocations.
+// D is the dimension if it is known at compile time, D == 0 means the dimension n is used.
+template <unsigned D>
+struct CGeometry
+{
+    static constexpr unsigned DIM = D;
+
+    static unsigned size( const unsigned n ) { return D ? D : n; }
+
+    static bool contains( const double * start_a, const double * dist_a,
+                          const double * start_b, const double * dist_b, const unsigned n )
+    {
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+            if( start_a[i] > start_b[i] || start_a[i] + dist_a[i] < start_b[i] + dist_b[i] )
+                return false;
+        return true;
+    }
+
+    static bool overlaps( const double * start_a, const double * dist_a,
+                          const double * start_b, const double * dist_b, const unsigned n )
+    {
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+            if( start_a[i] + dist_a[i] < start_b[i] || start_b[i] + dist_b[i] < start_a[i] )
+                return false;
+        return true;
+    }
+
+    // a becomes the MBR of a and b
+    static void merge( double * start_a, double * dist_a,
+                       const double * start_b, const double * dist_b, const unsigned n )
+    {
+        double end;
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+        {
+            end = max( start_a[i] + dist_a[i], start_b[i] + dist_b[i] );
+            start_a[i] = min( start_a[i], start_b[i] );
+            dist_a[i] = end - start_a[i];
+        }
+    }
+
+    static double volume( const double * dist, const unsigned n )
+    {
+        double volume = 1;
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+            volume *= dist[i];
+        return volume;
+    }
+
+    // volume of the MBR of a and b
+    static double mergedVolume( const double * start_a, const double * dist_a,
+                                const double * start_b, const double * dist_b, const unsigned n )
+    {
+        double volume = 1;
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+            volume *= max( start_a[i] + dist_a[i], start_b[i] + dist_b[i] ) - min( start_a[i], start_b[i] );
+        return volume;
+    }
+
+    // volume of the intersection of a and b
+    static double overlapVolume( const double * start_a, const double * dist_a,
+                                 const double * start_b, const double * dist_b, const unsigned n )
+    {
+        double volume = 1;
+        for( unsigned i = 0 ; i < size( n ) && volume > 0 ; i++ )
+            volume *= max( min( start_a[i] + dist_a[i], start_b[i] + dist_b[i] ) - max( start_a[i], start_b[i] ), 0.0 );
+        return volume;
+    }
+
+    // sum of the edge lengths, proportional to the perimeter
+    static double margin( const double * dist, const unsigned n )
+    {
+        double margin = 0;
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+            margin += dist[i];
+        return margin;
+    }
+
+    // squared distance of the point from the closest point of the hyperrectangle
+    static double mindist( const double * start, const double * dist, const double * point, const unsigned n )
+    {
+        double res = 0;
+        double r;
+        for( unsigned i = 0 ; i < size( n ) ; i++ )
+        {
+            if( point[i] < start[i] )
+                r = start[i] - point[i];
+            else if( point[i] > start[i] + dist[i] )
+                r = point[i] - ( start[i] + dist[i] );
+            else
+                r = 0;
+            res += r * r;
+        }
+        return res;
+    }
+};
+
+// calls f with the kernels specialized for the dimension, if there are any
+template <typename F>
+inline auto dispatchDimension( const unsigned dim, F f )
+{
+    switch( dim )
+    {
+    case 2:
+        return f( CGeometry<2>() );
+    case 3:
+        return f( CGeometry<3>() );
+    default:
+        return f( CGeometry<0>() );
+    }
+}
+
 class CHyperrectangle
 {
 public:
@@ -21,6 +134,7 @@ public:
     // Point/vector as hyperrectangle
     CHyperrectangle( const vector<double> & start );
 
+    // the other hyperrectangles and points have to be of the same dimension (checked only by asserts)
     bool contains( const CHyperrectangle & other ) const;
 
     bool overlaps( const CHyperrectangle & other ) const;
@@ -31,7 +145,15 @@ public:
 
     double volume() const;
 
-    double mindist( const vector<double> & point );
+    // volume of the MBR of this and other
+    double mergedVolume( const CHyperrectangle & other ) const;
+
+    // volume of the intersection of this and other
+    double overlapVolume( const CHyperrectangle & other ) const;
+
+    double margin() const;
+
+    double mindist( const vector<double> & point ) const;
 
     vector<double> & start();
 
@@ -53,4 +175,64 @@ CHyperrectangle merge( const CHyperrectangle & A, const CHyperrectangle & B );
 // debug
 ostream & operator<<( ostream & os, const CHyperrectangle & hrectangle );
 
+// Hyperrectangle of dimension D fixed at compile time, its coordinates are stored in place, so the
+// temporary MBRs of the insertion and the split do not allocate. See CBox for D == 0.
+template <unsigned D>
+class CFixedHyperrectangle
+{
+public:
+    CFixedHyperrectangle()
+        : start_(), dist_()
+    {}
+
+    // other has to be of dimension D
+    explicit CFixedHyperrectangle( const CHyperrectangle & other )
+    {
+        copy( other.start().begin(), other.start().begin() + D, start_.begin() );
+        copy( other.dist().begin(), other.dist().begin() + D, dist_.begin() );
+    }
+
+    void merge( const CHyperrectangle & other )
+    {
+        CGeometry<D>::merge( start_.data(), dist_.data(), other.start().data(), other.dist().data(), D );
+    }
+
+    double volume() const
+    {
+        return CGeometry<D>::volume( dist_.data(), D );
+    }
+
+    double overlapVolume( const CFixedHyperrectangle & other ) const
+    {
+        return CGeometry<D>::overlapVolume( start_.data(), dist_.data(), other.start_.data(), other.dist_.data(), D );
+    }
+
+    double overlapVolume( const CHyperrectangle & other ) const
+    {
+        return CGeometry<D>::overlapVolume( start_.data(), dist_.data(), other.start().data(), other.dist().data(), D );
+    }
+
+    double margin() const
+    {
+        return CGeometry<D>::margin( dist_.data(), D );
+    }
+
+private:
+    array<double, D> start_;
+    array<double, D> dist_;
+};
+
+// the hyperrectangle stored in place for the dimensions with specialized kernels (see dispatchDimension)
+template <unsigned D>
+struct CBox
+{
+    typedef CFixedHyperrectangle<D> type;
+};
+
+template <>
+struct CBox<0>
+{
+    typedef CHyperrectangle type;
+};
+
 #endif // CHYPERRECTANGLE_H
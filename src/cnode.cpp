@@ -1,26 +1,27 @@
 #include "cnode.h"
 
 CNode::CNode()
-    : id_( NULL_ID ), data_object_id_( NULL_ID )
+    : id_( NULL_ID ), parent_id_( NULL_ID ), lhv_( 0 ), count_( 0 ), data_object_id_( NULL_ID )
 {}
 
 CNode::CNode( const vector<double> & start, const vector<double> & dist, const uint32_t id )
-    : CHyperrectangle( start, dist ), id_( id ), data_object_id_( NULL_ID )
+    : CHyperrectangle( start, dist ), id_( id ), parent_id_( NULL_ID ), lhv_( 0 ), count_( 0 ), data_object_id_( NULL_ID )
 {}
 
 CNode::CNode( const vector<double> & start, const vector<double> & dist, const uint32_t id, const list<uint32_t> & child_nodes_id )
-    : CHyperrectangle( start, dist ), id_( id ), child_nodes_id_( child_nodes_id ), data_object_id_( NULL_ID )
+    : CHyperrectangle( start, dist ), id_( id ), parent_id_( NULL_ID ), lhv_( 0 ), count_( 0 ), child_nodes_id_( child_nodes_id ), data_object_id_( NULL_ID )
 {}
 
 CNode::CNode( const vector<double> & start, const vector<double> & dist, const uint32_t id, const uint32_t data_object_id )
-    : CHyperrectangle( start, dist ), id_( id ), data_object_id_( data_object_id )
+    : CHyperrectangle( start, dist ), id_( id ), parent_id_( NULL_ID ), lhv_( 0 ), count_( 1 ), data_object_id_( data_object_id )
 {}
 
-bool CNode::addChild( const CNode & child )
+void CNode::addChild( const CNode & child )
 {
     child_nodes_id_.push_back( child.id() );
     merge( child );
-    return ! ( child_nodes_id_.size() > MAX_CHILD_NODES );
+    lhv_ = max( lhv_, child.lhv_ );
+    count_ += child.count_;
 }
 
 bool CNode::isData() const { return child_nodes_id_.empty(); }
@@ -29,6 +30,18 @@ uint32_t & CNode::id() { return id_; };
 
 const uint32_t & CNode::id() const { return id_; }
 
+uint32_t & CNode::parent_id() { return parent_id_; }
+
+const uint32_t & CNode::parent_id() const { return parent_id_; }
+
+uint64_t & CNode::lhv() { return lhv_; }
+
+const uint64_t & CNode::lhv() const { return lhv_; }
+
+uint32_t & CNode::count() { return count_; }
+
+const uint32_t & CNode::count() const { return count_; }
+
 list<uint32_t> & CNode::child_nodes_id() { return child_nodes_id_; };
 
 const list<uint32_t> & CNode::child_nodes_id() const { return child_nodes_id_; };
@@ -37,9 +50,11 @@ uint32_t & CNode::data_object_id() { return data_object_id_; };
 
 const uint32_t & CNode::data_object_id() const { return data_object_id_; };
 
+shared_ptr<const CChildBoxes> CNode::child_boxes() const { return atomic_load( & child_boxes_ ); }
+
+void CNode::setChildBoxes( const shared_ptr<const CChildBoxes> & child_boxes ) { atomic_store( & child_boxes_, child_boxes ); }
+
 // default values preset
-unsigned CNode::MIN_CHILD_NODES = 2;
-unsigned CNode::MAX_CHILD_NODES = 50;
 uint32_t CNode::NULL_ID = 0;
 
 ostream & operator<< ( ostream & os, const CNode & node )
@@ -54,6 +69,7 @@ ostream & operator<< ( ostream & os, const CNode & node )
     }
     else
     {
+        os << " count: " << node.count();
         os << " child_nodes_id: ";
         for( auto x : node.child_nodes_id() )
             os << x << ", ";
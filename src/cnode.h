@@ -2,11 +2,14 @@
 #define CNODE_H
 
 #include "chyperrectangle.h"
+#include "cchildboxes.h"
 
 #include <cstdint>
 #include <vector>
 #include <list>
 #include <fstream>
+#include <memory>
+#include <algorithm>
 
 using namespace std;
 
@@ -21,8 +24,8 @@ public:
 
     CNode( const vector<double> & start, const vector<double> & dist, const uint32_t id, const uint32_t data_object_id );
 
-    // returns false if the node is overflowed
-    bool addChild( const CNode & child );
+    // the MBR, the LHV and the count include the child
+    void addChild( const CNode & child );
 
     bool isData() const;
 
@@ -30,6 +33,21 @@ public:
 
     const uint32_t & id() const;
 
+    // NULL_ID for the root
+    uint32_t & parent_id();
+
+    const uint32_t & parent_id() const;
+
+    // the largest Hilbert value of the data nodes in the subtree, kept by the Hilbert R-tree
+    uint64_t & lhv();
+
+    const uint64_t & lhv() const;
+
+    // number of the data nodes in the subtree, 1 for a data node
+    uint32_t & count();
+
+    const uint32_t & count() const;
+
     list<uint32_t> & child_nodes_id();
 
     const list<uint32_t> & child_nodes_id() const;
@@ -38,14 +56,22 @@ public:
 
     const uint32_t & data_object_id() const;
 
-    static uint32_t MIN_CHILD_NODES;
-    static uint32_t MAX_CHILD_NODES;
+    // MBRs of the children, valid only while the tree is not modified after they were built.
+    // They can be accessed by concurrent readers.
+    shared_ptr<const CChildBoxes> child_boxes() const;
+
+    void setChildBoxes( const shared_ptr<const CChildBoxes> & child_boxes );
+
     static uint32_t NULL_ID;
 
 private:
     uint32_t id_;
+    uint32_t parent_id_;
+    uint64_t lhv_;
+    uint32_t count_;
     list<uint32_t> child_nodes_id_;
     uint32_t data_object_id_;
+    shared_ptr<const CChildBoxes> child_boxes_;
 };
 
 ostream & operator<< ( ostream & os, const CNode & node );
@@ -0,0 +1,76 @@
+#include "cpredicate.h"
+
+CPredicate::CPredicate( const Type type, const CHyperrectangle & window, const double radius )
+    : type_( type ), window( window ), end( window.start().size() ), max_mindist( radius * radius )
+{
+    if( window.start().size() != window.dist().size() )
+        throw logic_error( "Wrong dimension." );
+
+    for( const auto x : window.dist() )
+        if( x < 0 )
+            throw logic_error( "The distance cannot be negative." );
+
+    if( radius < 0 )
+        throw logic_error( "The radius cannot be negative." );
+
+    for( unsigned i = 0 ; i < end.size() ; i++ )
+        end[i] = window.start()[i] + window.dist()[i];
+}
+
+CPredicate CPredicate::within( const vector<double> & start, const vector<double> & dist )
+{
+    return CPredicate( WITHIN, CHyperrectangle( start, dist ), 0 );
+}
+
+CPredicate CPredicate::intersects( const vector<double> & start, const vector<double> & dist )
+{
+    return CPredicate( INTERSECTS, CHyperrectangle( start, dist ), 0 );
+}
+
+CPredicate CPredicate::containsPoint( const vector<double> & point )
+{
+    return CPredicate( CONTAINS_POINT, CHyperrectangle( point ), 0 );
+}
+
+CPredicate CPredicate::withinDistance( const vector<double> & point, const double radius )
+{
+    return CPredicate( WITHIN_DISTANCE, CHyperrectangle( point ), radius );
+}
+
+CPredicate::Type CPredicate::type() const { return type_; }
+
+uint32_t CPredicate::dim() const { return window.start().size(); }
+
+bool CPredicate::matches( const CHyperrectangle & box ) const
+{
+    switch( type_ )
+    {
+    case WITHIN:
+        return window.contains( box );
+    case WITHIN_DISTANCE:
+        return box.mindist( window.start() ) <= max_mindist;
+    default:
+        // a point is an empty window
+        return window.overlaps( box );
+    }
+}
+
+void CPredicate::candidates( const CChildBoxes & boxes, vector<uint64_t> & mask ) const
+{
+    // quantized boxes of data nodes may exceed the window even if the data nodes do not
+    if( type_ == WITHIN && boxes.data() && boxes.exact() )
+        boxes.containedIn( window.start().data(), end.data(), mask );
+    else if( type_ == WITHIN_DISTANCE )
+        boxes.closerThan( window.start().data(), max_mindist, mask );
+    else
+        boxes.overlaps( window.start().data(), end.data(), mask );
+}
+
+void CPredicate::covered( const CChildBoxes & boxes, vector<uint64_t> & mask ) const
+{
+    // only the windows cover whole boxes
+    if( type_ == WITHIN || type_ == INTERSECTS )
+        boxes.containedIn( window.start().data(), end.data(), mask );
+    else
+        mask.assign( ( boxes.size() + 63 ) / 64, 0 );
+}
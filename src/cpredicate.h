@@ -0,0 +1,55 @@
+#ifndef CPREDICATE_H
+#define CPREDICATE_H
+
+#include "chyperrectangle.h"
+#include "cchildboxes.h"
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+// The condition the MBRs of the data objects returned by a search satisfy. It prunes the inner
+// nodes too, so every kind of query reads only the nodes which can contain a match.
+class CPredicate
+{
+public:
+    enum Type { WITHIN, INTERSECTS, CONTAINS_POINT, WITHIN_DISTANCE };
+
+    // the MBR lies within the window
+    static CPredicate within( const vector<double> & start, const vector<double> & dist );
+
+    // the MBR overlaps the window
+    static CPredicate intersects( const vector<double> & start, const vector<double> & dist );
+
+    static CPredicate containsPoint( const vector<double> & point );
+
+    // the Euclidean distance of the MBR from the point is at most radius
+    static CPredicate withinDistance( const vector<double> & point, const double radius );
+
+    Type type() const;
+
+    uint32_t dim() const;
+
+    bool matches( const CHyperrectangle & box ) const;
+
+    // Sets bit i of the mask if the i-th box may match. The boxes of inner nodes are selected if
+    // their subtrees may contain a match, exact boxes of data nodes only if they match.
+    void candidates( const CChildBoxes & boxes, vector<uint64_t> & mask ) const;
+
+    // sets bit i of the mask if every box lying within the i-th box matches
+    void covered( const CChildBoxes & boxes, vector<uint64_t> & mask ) const;
+
+private:
+    CPredicate( const Type type, const CHyperrectangle & window, const double radius );
+
+    Type type_;
+    // the point for the point queries
+    CHyperrectangle window;
+    vector<double> end;
+    // squared radius
+    double max_mindist;
+};
+
+#endif // CPREDICATE_H
@@ -1,87 +1,239 @@
 #include "crtree.h"
 
-CompareMindist::CompareMindist( const vector<double> & point )
-    : point( point )
-{}
+CNearestCursor::CNearestCursor( CRTree & rtree, const vector<double> & query_point )
+    : rtree( & rtree ), query_point( query_point ), distance_( 0 )
+{
+    if( rtree.next_id != 1 )
+        entries.push( CEntry{ 0, rtree.root_id, 0, false, true, false } );
+}
 
-bool CompareMindist::operator() ( shared_ptr<CNode> a, shared_ptr<CNode> b ) const
+bool CNearestCursor::next( tuple<uint32_t, vector<double>, vector<double>> & data_object )
 {
-    return a->mindist( point ) < b->mindist( point );
+    shared_ptr<const CNode> data_node;
+    if( ! next( data_node ) )
+        return false;
+
+    data_object = make_tuple( data_node->data_object_id(), data_node->start(), data_node->dist() );
+    return true;
 }
 
+bool CNearestCursor::next( shared_ptr<const CNode> & data_node )
+{
+    shared_lock<shared_mutex> lock( rtree->tree_mutex );
+    return step( data_node );
+}
 
-CRTree::CRTree( const string & pr_name, const uint32_t dim,
-                const uint32_t min_child_nodes, const uint32_t max_child_nodes,
-                const uint32_t cache_size, const uint32_t erased_max )
-    : pr_name( pr_name ), dim( dim ),
-      root_id( CNode::NULL_ID ), next_id( 1 ),
-      CACHE_SIZE( cache_size ), cache( CACHE_SIZE, nullptr ), ERASED_MAX( erased_max ),
-      last_op_io( 0 )
+bool CNearestCursor::step( shared_ptr<const CNode> & data_node )
 {
-    CNode::MIN_CHILD_NODES = min_child_nodes;
-    CNode::MAX_CHILD_NODES = max_child_nodes;
+    CEntry current;
+    shared_ptr<const CChildBoxes> boxes;
 
-    NODE_SIZE = 2 * dim * sizeof( double ) + 2 * sizeof( uint32_t ) + CNode::MAX_CHILD_NODES * sizeof( uint32_t );
+    while( ! entries.empty() )
+    {
+        current = entries.top();
+        entries.pop();
 
-    file.open( pr_name, ios::in );
-    if( file.good() ) throw logic_error( "\"" + pr_name + "\"" + " already exists." );
+        if( current.data )
+        {
+            data_node = rtree->at( current.id, stats_ );
+            if( ! current.visited )
+                stats_.visit( current.depth );
 
-    file.open( pr_name, ios::in | ios::out | ios::binary | ios::trunc );
-    if( ! file.is_open() ) throw runtime_error( "\"" + pr_name + "\"" + " can't be opened." );
+            // the entry is queued again with the exact distance
+            if( ! current.exact )
+            {
+                entries.push( CEntry{ data_node->mindist( query_point ), current.id, current.depth, true, true, true } );
+                continue;
+            }
 
-    HEADER_SIZE = sizeof ( dim ) + sizeof ( root_id ) + sizeof ( next_id ) + sizeof ( CACHE_SIZE ) + sizeof ( ERASED_MAX )
-                + sizeof ( CNode::MIN_CHILD_NODES ) + sizeof ( CNode::MAX_CHILD_NODES ) + sizeof ( CNode::NULL_ID );
+            distance_ = current.mindist;
+            return true;
+        }
 
-    save();
+        boxes = rtree->childBoxes( rtree->at( current.id, stats_ ), stats_ );
+        stats_.visit( current.depth );
+        stats_.compared += boxes->size();
+        mindists.resize( boxes->size() );
+        boxes->mindist( query_point.data(), mindists.data() );
+        for( uint32_t i = 0 ; i < boxes->size() ; i++ )
+            entries.push( CEntry{ mindists[i], boxes->id( i ), current.depth + 1, boxes->data(), boxes->exact(), false } );
+    }
+
+    return false;
 }
 
-CRTree::CRTree( const string & pr_name )
-    : pr_name( pr_name ), last_op_io( 0 )
-{
+double CNearestCursor::distance() const { return distance_; }
 
-    file.open( pr_name, ios::in | ios::out | ios::binary );
-    if( ! file.is_open() ) throw runtime_error( "\"" + pr_name + "\"" + " cannot be opened." );
+const CStats & CNearestCursor::stats() const { return stats_; }
 
-    file.read( ( char * ) & dim, sizeof ( dim ) );
-    file.read( ( char * ) & root_id, sizeof ( root_id ) );
-    file.read( ( char * ) & next_id, sizeof ( next_id ) );
-    file.read( ( char * ) & ERASED_MAX, sizeof ( ERASED_MAX ) );
-    file.read( ( char * ) & CACHE_SIZE, sizeof ( CACHE_SIZE ) );
-    file.read( ( char * ) & CNode::MIN_CHILD_NODES, sizeof ( CNode::MIN_CHILD_NODES ) );
-    file.read( ( char * ) & CNode::MAX_CHILD_NODES, sizeof ( CNode::MAX_CHILD_NODES ) );
-    file.read( ( char * ) & CNode::NULL_ID, sizeof ( CNode::NULL_ID ) );
+bool CNearestCursor::CEntry::operator>( const CEntry & other ) const
+{
+    return mindist > other.mindist;
+}
 
-    if( file.bad() ) throw runtime_error( "\"" + pr_name + "\" is corrupted." );
+void CStats::visit( const uint32_t depth )
+{
+    if( visited.size() <= depth )
+        visited.resize( depth + 1, 0 );
+    visited[ depth ]++;
+}
 
-    cache = vector<shared_ptr<CNode>>( CACHE_SIZE, nullptr );
+CStats & CStats::operator+=( const CStats & other )
+{
+    operations += other.operations;
+    seconds += other.seconds;
+    if( visited.size() < other.visited.size() )
+        visited.resize( other.visited.size(), 0 );
+    for( size_t depth = 0 ; depth < other.visited.size() ; depth++ )
+        visited[ depth ] += other.visited[ depth ];
+    cache_hits += other.cache_hits;
+    cache_misses += other.cache_misses;
+    reads += other.reads;
+    writes += other.writes;
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    splits += other.splits;
+    compared += other.compared;
+    return * this;
+}
 
-    NODE_SIZE = 2 * dim * sizeof( double ) + 2 * sizeof( uint32_t ) + CNode::MAX_CHILD_NODES * sizeof( uint32_t );
+// sequential encoding of fixed size values
+template <typename T>
+static void writeValue( char * & buffer, const T & value )
+{
+    memcpy( buffer, & value, sizeof( value ) );
+    buffer += sizeof( value );
+}
 
-    HEADER_SIZE = sizeof ( dim ) + sizeof ( root_id ) + sizeof ( next_id ) + sizeof ( CACHE_SIZE ) + sizeof ( ERASED_MAX )
-                + sizeof ( CNode::MIN_CHILD_NODES ) + sizeof ( CNode::MAX_CHILD_NODES ) + sizeof ( CNode::NULL_ID );
+template <typename T>
+static void readValue( const char * & buffer, T & value )
+{
+    memcpy( & value, buffer, sizeof( value ) );
+    buffer += sizeof( value );
+}
 
-    file.seekg( HEADER_SIZE + next_id * NODE_SIZE );
-    uint64_t erased_size;
-    file.read( ( char * ) & erased_size, sizeof ( erased_size ) );
-    uint32_t tmp;
-    for( unsigned i = 0 ; i < erased_size ; i++ )
+// FNV-1a, detects the id sets overwritten by nodes
+static uint64_t checksum( const char * buffer, const size_t size )
+{
+    uint64_t retval = 14695981039346656037ull;
+    for( size_t i = 0 ; i < size ; i++ )
     {
-        file.read( ( char * ) & tmp, sizeof( tmp ) );
-        erased.insert( tmp );
+        retval ^= ( unsigned char ) buffer[i];
+        retval *= 1099511628211ull;
     }
+    return retval;
+}
+
+CRTree::CRTree( const string & pr_name, const uint32_t dim,
+                const uint32_t min_child_nodes, const uint32_t max_child_nodes,
+                const uint32_t cache_size, const uint32_t erased_max,
+                const CStorage::Backend backend, const Insertion insertion,
+                const CSplitStrategy::Algorithm split_algorithm, const Encoding encoding )
+    : CRTree( pr_name, dim, min_child_nodes, max_child_nodes, cache_size, erased_max,
+              backend, insertion, split_algorithm, PACKED, encoding )
+{}
+
+CRTree::CRTree( const string & pr_name, const uint32_t dim, const PageSize page_size,
+                const uint32_t cache_size,
+                const CStorage::Backend backend, const Insertion insertion,
+                const CSplitStrategy::Algorithm split_algorithm, const Encoding encoding )
+    // the nodes are filled at least by 40 %, as recommended for the R*-tree
+    : CRTree( pr_name, dim, max( 1u, pageFanout( dim, page_size, encoding ) * 2 / 5 ), pageFanout( dim, page_size, encoding ),
+              cache_size, 0, backend, insertion, split_algorithm, page_size, encoding )
+{}
+
+CRTree::CRTree( const string & pr_name, const uint32_t dim,
+                const uint32_t min_child_nodes, const uint32_t max_child_nodes,
+                const uint32_t cache_size, const uint32_t erased_max,
+                const CStorage::Backend backend, const Insertion insertion,
+                const CSplitStrategy::Algorithm split_algorithm, const PageSize page_size, const Encoding encoding )
+    : pr_name( pr_name ), page_size( page_size ), encoding( encoding ), dim( dim ),
+      root_id( CNode::NULL_ID ), next_id( 1 ), ids_loaded( true ), ids_offset( 0 ),
+      CACHE_SIZE( cache_size ), cache( CACHE_SIZE * CBufferPool::footprint( dim, max_child_nodes ) ),
+      ERASED_MAX( erased_max ), insertion( insertion ), splitter( CSplitStrategy::create( split_algorithm ) ),
+      batch_threads( thread::hardware_concurrency() ), write_back( false ), commit_interval( 0 ), uncommitted( 0 ), read_only( false )
+{
+    if( insertion == HILBERT && dim > 64 )
+        throw logic_error( "The Hilbert R-tree supports at most 64 dimensions." );
+
+    MIN_CHILD_NODES = min_child_nodes;
+    MAX_CHILD_NODES = max_child_nodes;
+
+    NODE_SIZE = page_size ? ( uint32_t ) page_size : recordSize( dim, MAX_CHILD_NODES, encoding );
 
-    retrieveUsedIds();
+    if( ifstream( pr_name ).good() ) throw logic_error( "\"" + pr_name + "\"" + " already exists." );
+
+    storage = CStorage::open( pr_name, backend, true );
+
+    HEADER_SIZE = sizeof ( dim ) + sizeof ( root_id ) + sizeof ( next_id ) + sizeof ( CACHE_SIZE ) + sizeof ( ERASED_MAX )
+                + sizeof ( MIN_CHILD_NODES ) + sizeof ( MAX_CHILD_NODES ) + sizeof ( CNode::NULL_ID )
+                + sizeof ( uint32_t ) + sizeof ( uint32_t ) + sizeof ( uint32_t ) + sizeof ( uint32_t );
+
+    save();
+}
+
+CRTree::CRTree( const string & pr_name, const CStorage::Backend backend, const bool read_only )
+    : pr_name( pr_name ), ids_loaded( false ), batch_threads( thread::hardware_concurrency() ),
+      write_back( false ), commit_interval( 0 ), uncommitted( 0 ), read_only( read_only )
+{
+    storage = CStorage::open( pr_name, backend, false );
+
+    HEADER_SIZE = sizeof ( dim ) + sizeof ( root_id ) + sizeof ( next_id ) + sizeof ( CACHE_SIZE ) + sizeof ( ERASED_MAX )
+                + sizeof ( MIN_CHILD_NODES ) + sizeof ( MAX_CHILD_NODES ) + sizeof ( CNode::NULL_ID )
+                + sizeof ( uint32_t ) + sizeof ( uint32_t ) + sizeof ( uint32_t ) + sizeof ( uint32_t );
+
+    vector<char> header( HEADER_SIZE );
+    storage->read( 0, header.data(), HEADER_SIZE );
+
+    const char * buffer = header.data();
+    readValue( buffer, dim );
+    readValue( buffer, root_id );
+    readValue( buffer, next_id );
+    readValue( buffer, ERASED_MAX );
+    readValue( buffer, CACHE_SIZE );
+    readValue( buffer, MIN_CHILD_NODES );
+    readValue( buffer, MAX_CHILD_NODES );
+    readValue( buffer, CNode::NULL_ID );
+    uint32_t insertion_u, split_u, page_size_u, encoding_u;
+    readValue( buffer, insertion_u );
+    readValue( buffer, split_u );
+    readValue( buffer, page_size_u );
+    readValue( buffer, encoding_u );
+    insertion = ( Insertion ) insertion_u;
+    page_size = ( PageSize ) page_size_u;
+    encoding = ( Encoding ) encoding_u;
+
+    if( dim == 0 || next_id == 0 || MAX_CHILD_NODES == 0 || insertion_u > HILBERT || split_u > CSplitStrategy::ANG_TAN
+        || encoding_u > COMPACT
+        || ( page_size != PACKED && page_size != PAGE_4K && page_size != PAGE_8K && page_size != PAGE_16K )
+        || ( page_size && MAX_CHILD_NODES > pageFanout( dim, page_size, encoding ) ) )
+        throw runtime_error( "\"" + pr_name + "\" is corrupted." );
+
+    splitter = CSplitStrategy::create( ( CSplitStrategy::Algorithm ) split_u );
+
+    cache.setBudget( CACHE_SIZE * CBufferPool::footprint( dim, MAX_CHILD_NODES ) );
+
+    NODE_SIZE = page_size ? ( uint32_t ) page_size : recordSize( dim, MAX_CHILD_NODES, encoding );
+
+    // The list of erased data objects is kept for the compatibility of the file format, it is
+    // empty in all the files of this format. The ids are not read until they are needed.
+    uint64_t erased_size;
+    storage->read( offset( next_id ) + NODE_SIZE, ( char * ) & erased_size, sizeof ( erased_size ) );
+    ids_offset = offset( next_id ) + NODE_SIZE + sizeof ( erased_size ) + erased_size * sizeof( uint32_t );
 }
 
 CRTree::~CRTree()
 {
-    save();
-    file.close();
+    if( ! read_only )
+        save();
 }
 
 void CRTree::insert( const uint32_t data_object_id, const vector<double> & start, const vector<double> & dist )
 {
-    last_op_io = 0;
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+    checkWritable();
 
     if( start.size() != dim || dist.size() != dim )
         throw logic_error( "Wrong dimension." );
@@ -90,74 +242,415 @@ void CRTree::insert( const uint32_t data_object_id, const vector<double> & start
         if( x < 0 )
             throw logic_error( "The distance cannot be negative." );
 
-    if( data_object_ids_used.count( data_object_id ) )
+    if( usedIds().count( data_object_id ) )
         throw logic_error( "The data object with id " + to_string( data_object_id ) + " already exists." );
 
-    if( erased.count( data_object_id ) )
-        rebuild();
+    reinserted_levels.clear();
 
-    parent_nodes.clear();
-    data_object_ids_used.insert( data_object_id );
-
-    shared_ptr<CNode> to_insert( new CNode( start, dist, next_id, data_object_id ) );
-    writeNode( to_insert );
-    next_id++;
+    shared_ptr<CNode> to_insert( new CNode( start, dist, allocate(), data_object_id ) );
+    to_insert->lhv() = hilbertKey( * to_insert );
+    data_object_ids_used.emplace( data_object_id, to_insert->id() );
 
     // if to_insert is the first node
-    if( next_id == 2 )
+    if( root_id == CNode::NULL_ID )
     {
-        shared_ptr<CNode> root( new CNode( start, dist, next_id, list<uint32_t>{ to_insert->id() } ) );
-        cache.at( next_id ) = root;
-        next_id++;
+        shared_ptr<CNode> root( new CNode( start, dist, allocate(), list<uint32_t>{ to_insert->id() } ) );
+        to_insert->parent_id() = root->id();
+        root->lhv() = to_insert->lhv();
+        root->count() = 1;
+        writeNode( to_insert );
         writeNode( root );
         root_id = root->id();
+        commit();
+        record( op_stats, started );
         return;
     }
 
-    shared_ptr<CNode> destination = chooseLeaf( at( root_id ), to_insert );
+    insertNode( to_insert, 1 );
+    commit();
+    record( op_stats, started );
+}
 
-    shared_ptr<CNode> split_partner = nullptr;
-    if( ! destination->addChild( * to_insert ) )
+void CRTree::bulkLoad( const list<tuple<uint32_t, vector<double>, vector<double>>> & data_objects )
+{
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+    checkWritable();
+
+    unordered_set<uint32_t> ids;
+    for( const auto & data_object : data_objects )
     {
-        pair<shared_ptr<CNode> &, shared_ptr<CNode> &>( destination, split_partner ) = split( destination );
+        if( get<1>( data_object ).size() != dim || get<2>( data_object ).size() != dim )
+            throw logic_error( "Wrong dimension." );
+
+        for( const auto x : get<2>( data_object ) )
+            if( x < 0 )
+                throw logic_error( "The distance cannot be negative." );
+
+        if( usedIds().count( get<0>( data_object ) ) || ! ids.insert( get<0>( data_object ) ).second )
+            throw logic_error( "The data object with id " + to_string( get<0>( data_object ) ) + " already exists." );
     }
-    adjustTree( destination, split_partner );
+
+    list<tuple<uint32_t, vector<double>, vector<double>>> to_pack = dataObjects();
+    to_pack.insert( to_pack.end(), data_objects.begin(), data_objects.end() );
+
+    pack( to_pack );
+    record( op_stats, started );
 }
 
 list<tuple<uint32_t, vector<double>, vector<double>>> CRTree::search( const vector<double> & start, const vector<double> & dist )
 {
-    last_op_io = 0;
+    return search( CPredicate::within( start, dist ) );
+}
 
-    if( start.size() != dim || dist.size() != dim )
+unsigned CRTree::search( const vector<double> & start, const vector<double> & dist, const CDataVisitor & visitor )
+{
+    return search( CPredicate::within( start, dist ), visitor );
+}
+
+size_t CRTree::count( const vector<double> & start, const vector<double> & dist )
+{
+    return count( CPredicate::within( start, dist ) );
+}
+
+list<tuple<uint32_t, vector<double>, vector<double>>> CRTree::search( const CPredicate & predicate )
+{
+    list<tuple<uint32_t, vector<double>, vector<double>>> retval;
+
+    search( predicate, [&retval]( const CNode & data_node )
+    {
+        retval.push_back( make_tuple( data_node.data_object_id(), data_node.start(), data_node.dist() ) );
+        return true;
+    } );
+
+    return retval;
+}
+
+unsigned CRTree::search( const CPredicate & predicate, const CDataVisitor & visitor )
+{
+    if( predicate.dim() != dim )
         throw logic_error( "Wrong dimension." );
 
-    for( const auto x : dist )
-        if( x < 0 )
-            throw logic_error( "The distance cannot be negative." );
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    shared_lock<shared_mutex> lock( tree_mutex );
+    CStats stats;
 
-    if( next_id == 1 )
-        return {};
+    // depth-first, so at most height * MAX_CHILD_NODES ids (with their depths) are waiting
+    stack<pair<uint32_t, uint32_t>> s;
+    if( next_id != 1 )
+        s.push( make_pair( root_id, 0 ) );
+    pair<uint32_t, uint32_t> current;
+    shared_ptr<const CChildBoxes> boxes;
+    vector<uint64_t> mask;
+    bool proceed = true;
 
-    CHyperrectangle searchArea( start, dist );
+    while( proceed && ! s.empty() )
+    {
+        current = s.top();
+        s.pop();
+        boxes = childBoxes( at( current.first, stats ), stats );
+        stats.visit( current.second );
+        stats.compared += boxes->size();
+
+        predicate.candidates( * boxes, mask );
+        // the data nodes are filtered by their MBRs already stored in the leaf,
+        // the ones selected by quantized MBRs are checked exactly
+        if( boxes->data() )
+            proceed = forEachBit( mask, [&]( const uint32_t i )
+            {
+                shared_ptr<CNode> data_node = at( boxes->id( i ), stats );
+                stats.visit( current.second + 1 );
+                return ( ! boxes->exact() && ! predicate.matches( * data_node ) ) || visitor( * data_node );
+            } );
+        else
+            forEachBit( mask, [&]( const uint32_t i ) { s.push( make_pair( boxes->id( i ), current.second + 1 ) ); return true; } );
+    }
 
-    list<tuple<uint32_t, vector<double>, vector<double>>> retval;
+    record( stats, started );
+    return stats.reads;
+}
 
-    queue<shared_ptr<CNode>> q;
-    q.push( at( root_id ) );
-    shared_ptr<CNode> current;
+size_t CRTree::count( const CPredicate & predicate )
+{
+    if( predicate.dim() != dim )
+        throw logic_error( "Wrong dimension." );
 
-    while( ! q.empty() )
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    shared_lock<shared_mutex> lock( tree_mutex );
+    CStats stats;
+    size_t retval = 0;
+
+    stack<pair<uint32_t, uint32_t>> s;
+    if( next_id != 1 )
+        s.push( make_pair( root_id, 0 ) );
+    pair<uint32_t, uint32_t> current;
+    shared_ptr<const CChildBoxes> boxes;
+    vector<uint64_t> covered, candidates;
+
+    while( ! s.empty() )
     {
-        current = q.front();
-        q.pop();
+        current = s.top();
+        s.pop();
+        boxes = childBoxes( at( current.first, stats ), stats );
+        stats.visit( current.second );
+        stats.compared += boxes->size();
+
+        // a child whose (possibly quantized) MBR is covered by the predicate is covered too
+        predicate.covered( * boxes, covered );
+        if( boxes->data() )
+            for( const uint64_t word : covered )
+                retval += __builtin_popcountll( word );
+        else
+            forEachBit( covered, [&]( const uint32_t i )
+            {
+                retval += at( boxes->id( i ), stats )->count();
+                stats.visit( current.second + 1 );
+                return true;
+            } );
 
-        for( const uint32_t child_node_id : current->child_nodes_id() )
-            if( searchArea.overlaps( * at( child_node_id ) ) )
-                q.push( at( child_node_id ) );
+        // the others may match only partially, the data nodes among them are checked exactly
+        predicate.candidates( * boxes, candidates );
+        for( size_t word = 0 ; word < candidates.size() ; word++ )
+            candidates[ word ] &= ~ covered[ word ];
+
+        forEachBit( candidates, [&]( const uint32_t i )
+        {
+            if( ! boxes->data() )
+                s.push( make_pair( boxes->id( i ), current.second + 1 ) );
+            else if( boxes->exact() )
+                retval++;
+            else
+            {
+                retval += predicate.matches( * at( boxes->id( i ), stats ) );
+                stats.visit( current.second + 1 );
+            }
+            return true;
+        } );
+    }
+
+    record( stats, started );
+    return retval;
+}
+
+vector<list<tuple<uint32_t, vector<double>, vector<double>>>> CRTree::searchBatch( const vector<pair<vector<double>, vector<double>>> & queries,
+                                                                                   CBatchStats * stats )
+{
+    return runBatch( queries.size(), [&]( const size_t i, list<tuple<uint32_t, vector<double>, vector<double>>> & results )
+    {
+        return search( queries[i].first, queries[i].second, [&results]( const CNode & data_node )
+        {
+            results.push_back( make_tuple( data_node.data_object_id(), data_node.start(), data_node.dist() ) );
+            return true;
+        } );
+    }, stats );
+}
+
+vector<list<tuple<uint32_t, vector<double>, vector<double>>>> CRTree::knnBatch( const unsigned k, const vector<vector<double>> & query_points,
+                                                                                CBatchStats * stats )
+{
+    return runBatch( query_points.size(), [&]( const size_t i, list<tuple<uint32_t, vector<double>, vector<double>>> & results )
+    {
+        return knn( k, query_points[i], [&results]( const CNode & data_node )
+        {
+            results.push_back( make_tuple( data_node.data_object_id(), data_node.start(), data_node.dist() ) );
+            return true;
+        } );
+    }, stats );
+}
+
+void CRTree::setBatchThreads( const unsigned threads )
+{
+    lock_guard<mutex> lock( pool_mutex );
+    batch_threads = threads;
+    pool.reset();
+}
+
+unsigned CRTree::join( CRTree & other, const CJoinVisitor & visitor )
+{
+    if( other.dim != dim )
+        throw logic_error( "Wrong dimension." );
+
+    // the trees are locked by the pool's run, see pool_mutex
+    lock_guard<mutex> pool_lock( pool_mutex );
+    if( ! pool )
+        pool.reset( new CThreadPool( batch_threads ) );
+
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    shared_lock<shared_mutex> lock( tree_mutex, defer_lock ), other_lock( other.tree_mutex, defer_lock );
+
+    // the statistics of both trees are recorded by this one
+    CStats stats;
+    CJoin join( other, visitor );
+    vector<pair<uint32_t, uint32_t>> pairs, expanded;
+    vector<CStats> pair_stats;
+    pool->run( [&]() -> size_t
+    {
+        if( & other == this )
+            lock.lock();
+        else
+            std::lock( lock, other_lock );
+
+        if( next_id == 1 || other.next_id == 1 )
+            return 0;
+
+        // the pairs are expanded breadth-first until there are enough of them for the threads
+        pairs.push_back( make_pair( root_id, other.root_id ) );
+        while( ! pairs.empty() && pairs.size() < 4 * pool->size() && ! join.stopped )
+        {
+            expanded.clear();
+            for( const auto & nodes : pairs )
+                if( ! joinStep( join, nodes, stats, expanded ) )
+                    break;
+            pairs.swap( expanded );
+        }
+
+        pair_stats.resize( pairs.size() );
+        return join.stopped ? 0 : pairs.size();
+    }, [&]( const size_t i )
+    {
+        // depth-first, the pairs of one subtree pair are independent of the others
+        vector<pair<uint32_t, uint32_t>> stack{ pairs[i] };
+        pair<uint32_t, uint32_t> nodes;
+        while( ! stack.empty() && ! join.stopped )
+        {
+            nodes = stack.back();
+            stack.pop_back();
+            joinStep( join, nodes, pair_stats[i], stack );
+        }
+    } );
+
+    for( const CStats & x : pair_stats )
+        stats += x;
+
+    record( stats, started );
+    return stats.reads;
+}
+
+CRTree::CJoin::CJoin( CRTree & other, const CJoinVisitor & visitor )
+    : other( other ), visitor( visitor ), stopped( false )
+{}
+
+bool CRTree::joinStep( CJoin & join, const pair<uint32_t, uint32_t> & nodes, CStats & stats, vector<pair<uint32_t, uint32_t>> & pairs )
+{
+    CRTree & other = join.other;
+    shared_ptr<CNode> node = at( nodes.first, stats );
+    shared_ptr<CNode> other_node = other.at( nodes.second, stats );
+    shared_ptr<const CChildBoxes> boxes = childBoxes( node, stats );
+    shared_ptr<const CChildBoxes> other_boxes = other.childBoxes( other_node, stats );
+    stats.compared += boxes->size() + other_boxes->size();
+
+    // search space restriction: only the children overlapping both nodes can form pairs
+    vector<double> low( dim ), high( dim );
+    for( unsigned i = 0 ; i < dim ; i++ )
+    {
+        low[i] = max( node->start()[i], other_node->start()[i] );
+        high[i] = min( node->start()[i] + node->dist()[i], other_node->start()[i] + other_node->dist()[i] );
+    }
+
+    vector<uint64_t> mask;
+    if( boxes->data() != other_boxes->data() )
+    {
+        const bool leaf = boxes->data();
+        const shared_ptr<const CChildBoxes> & higher = leaf ? other_boxes : boxes;
+        higher->overlaps( low.data(), high.data(), mask );
+        forEachBit( mask, [&]( const uint32_t i )
+        {
+            pairs.push_back( leaf ? make_pair( nodes.first, higher->id( i ) ) : make_pair( higher->id( i ), nodes.second ) );
+            return true;
+        } );
+        return true;
+    }
+
+    // the candidates sorted by their lower coordinates along the first axis
+    vector<uint32_t> candidates, other_candidates;
+    boxes->overlaps( low.data(), high.data(), mask );
+    forEachBit( mask, [&]( const uint32_t i ) { candidates.push_back( i ); return true; } );
+    other_boxes->overlaps( low.data(), high.data(), mask );
+    forEachBit( mask, [&]( const uint32_t i ) { other_candidates.push_back( i ); return true; } );
+    sort( candidates.begin(), candidates.end(), [&]( const uint32_t a, const uint32_t b ) { return boxes->lower( 0, a ) < boxes->lower( 0, b ); } );
+    sort( other_candidates.begin(), other_candidates.end(), [&]( const uint32_t a, const uint32_t b ) { return other_boxes->lower( 0, a ) < other_boxes->lower( 0, b ); } );
+
+    // the pair overlaps along the first axis already
+    auto report = [&]( const uint32_t i, const uint32_t j )
+    {
+        for( unsigned axis = 1 ; axis < dim ; axis++ )
+            if( boxes->upper( axis, i ) < other_boxes->lower( axis, j ) || other_boxes->upper( axis, j ) < boxes->lower( axis, i ) )
+                return true;
+
+        if( ! boxes->data() )
+        {
+            pairs.push_back( make_pair( boxes->id( i ), other_boxes->id( j ) ) );
+            return true;
+        }
+
+        // quantized MBRs only select the candidates
+        shared_ptr<CNode> data_node = at( boxes->id( i ), stats );
+        shared_ptr<CNode> other_data_node = other.at( other_boxes->id( j ), stats );
+        if( ( ! boxes->exact() || ! other_boxes->exact() ) && ! data_node->overlaps( * other_data_node ) )
+            return true;
+
+        lock_guard<mutex> lock( join.visitor_mutex );
+        if( join.stopped || ! join.visitor( data_node->data_object_id(), other_data_node->data_object_id() ) )
+            join.stopped = true;
+        return ! join.stopped;
+    };
+
+    size_t i = 0, j = 0;
+    while( i < candidates.size() && j < other_candidates.size() )
+    {
+        if( boxes->lower( 0, candidates[i] ) <= other_boxes->lower( 0, other_candidates[j] ) )
+        {
+            for( size_t k = j ; k < other_candidates.size() && other_boxes->lower( 0, other_candidates[k] ) <= boxes->upper( 0, candidates[i] ) ; k++ )
+                if( ! report( candidates[i], other_candidates[k] ) )
+                    return false;
+            i++;
+        }
+        else
+        {
+            for( size_t k = i ; k < candidates.size() && boxes->lower( 0, candidates[k] ) <= other_boxes->upper( 0, other_candidates[j] ) ; k++ )
+                if( ! report( candidates[k], other_candidates[j] ) )
+                    return false;
+            j++;
+        }
+    }
+
+    return true;
+}
+
+vector<list<tuple<uint32_t, vector<double>, vector<double>>>> CRTree::runBatch( const size_t count,
+                                                                                const function<unsigned( const size_t, list<tuple<uint32_t, vector<double>, vector<double>>> & )> & query,
+                                                                                CBatchStats * stats )
+{
+    vector<list<tuple<uint32_t, vector<double>, vector<double>>>> retval( count );
+    vector<unsigned> io( count );
+    vector<double> seconds( count );
 
-        if( current->isData() && searchArea.contains( * current ) )
-            if( ! erased.count( current->data_object_id() ) )
-                retval.push_back( make_tuple( current->data_object_id(), current->start(), current->dist() ) );
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> lock( pool_mutex );
+        if( ! pool )
+            pool.reset( new CThreadPool( batch_threads ) );
+
+        pool->run( count, [&]( const size_t i )
+        {
+            chrono::steady_clock::time_point query_start = chrono::steady_clock::now();
+            io[i] = query( i, retval[i] );
+            seconds[i] = chrono::duration<double>( chrono::steady_clock::now() - query_start ).count();
+        } );
+    }
+
+    if( stats )
+    {
+        * stats = CBatchStats{ count, 0, 0, 0, chrono::duration<double>( chrono::steady_clock::now() - start ).count(), 0, 0 };
+        for( size_t i = 0 ; i < count ; i++ )
+        {
+            stats->results += retval[i].size();
+            stats->io += io[i];
+            stats->max_io = max<uint64_t>( stats->max_io, io[i] );
+            stats->query_seconds += seconds[i];
+            stats->max_query_seconds = max( stats->max_query_seconds, seconds[i] );
+        }
     }
 
     return retval;
@@ -165,28 +658,118 @@ list<tuple<uint32_t, vector<double>, vector<double>>> CRTree::search( const vect
 
 void CRTree::erase( const uint32_t id )
 {
-    last_op_io = 0;
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+    checkWritable();
 
-    if( ! data_object_ids_used.count( id ) )
+    auto data_object = usedIds().find( id );
+    if( data_object == data_object_ids_used.end() )
         throw logic_error( "Data object with id " + to_string( id ) + " does not exist." );
 
-    data_object_ids_used.erase( id );
+    shared_ptr<CNode> data_node = at( data_object->second );
+    reinserted_levels.clear();
+
+    // the leaf is found by the parent pointer, without searching the tree
+    shared_ptr<CNode> leaf = at( data_node->parent_id() );
+    const size_t children = leaf->child_nodes_id().size();
+    leaf->child_nodes_id().remove( data_node->id() );
+    if( leaf->child_nodes_id().size() == children )
+        throw runtime_error( "\"" + pr_name + "\"" + " is corrupted" );
+    data_object_ids_used.erase( data_object );
+    release( data_node->id() );
+
+    condenseTree( leaf );
+    commit();
+    record( op_stats, started );
+}
 
-    erased.insert( id );
+unsigned CRTree::lastOpIO() const
+{
+    lock_guard<mutex> lock( stats_mutex );
+    return last_op_stats.reads + last_op_stats.writes;
+}
 
-    if( erased.size() > ERASED_MAX )
-        rebuild();
+CStats CRTree::lastOpStats() const
+{
+    lock_guard<mutex> lock( stats_mutex );
+    return last_op_stats;
 }
 
-unsigned CRTree::lastOpIO() const { return last_op_io; }
+CStats CRTree::totalStats() const
+{
+    lock_guard<mutex> lock( stats_mutex );
+    return total_stats;
+}
+
+void CRTree::resetStats()
+{
+    lock_guard<mutex> lock( stats_mutex );
+    last_op_stats = CStats();
+    total_stats = CStats();
+}
+
+void CRTree::record( CStats & stats, const chrono::steady_clock::time_point & start )
+{
+    stats.operations = 1;
+    stats.seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+    lock_guard<mutex> lock( stats_mutex );
+    last_op_stats = stats;
+    total_stats += stats;
+}
+
+void CRTree::setCacheBudget( const size_t budget ) { cache.setBudget( budget ); }
+
+void CRTree::setCachePolicy( const CBufferPool::Policy policy ) { cache.setPolicy( policy ); }
+
+const CBufferPool & CRTree::getCache() const { return cache; }
+
+void CRTree::setWriteBack( const bool write_back, const uint32_t commit_interval )
+{
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+
+    if( ! write_back )
+        writeDirty();
+
+    this->write_back = write_back;
+    this->commit_interval = commit_interval;
+    record( op_stats, started );
+}
+
+void CRTree::flush()
+{
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+    checkWritable();
+
+    save();
+    record( op_stats, started );
+}
 
 shared_ptr<CNode> CRTree::at( const uint32_t id )
 {
-    if( ! cache.at( id % CACHE_SIZE ) || cache.at( id % CACHE_SIZE )->id() != id )
+    return at( id, op_stats );
+}
+
+shared_ptr<CNode> CRTree::at( const uint32_t id, CStats & stats )
+{
+    shared_ptr<CNode> retval = cache.get( id );
+    if( retval )
+        stats.cache_hits++;
+    else
     {
-        cache.at( id % CACHE_SIZE ) = readNode( id );
+        // concurrent readers may read the same node, then the last one stays cached
+        retval = readNode( id );
+        stats.cache_misses++;
+        stats.reads++;
+        stats.bytes_read += NODE_SIZE;
+        cache.put( retval );
     }
-    return cache.at( id % CACHE_SIZE );
+    return retval;
 }
 
 bool CRTree::isLeaf( shared_ptr<CNode> node )
@@ -194,17 +777,75 @@ bool CRTree::isLeaf( shared_ptr<CNode> node )
     return at( node->child_nodes_id().front() )->isData();
 }
 
-shared_ptr<CNode> CRTree::chooseLeaf( shared_ptr<CNode> current, const shared_ptr<CNode> to_insert )
+shared_ptr<const CChildBoxes> CRTree::childBoxes( const shared_ptr<CNode> & node, CStats & stats )
 {
-    if( isLeaf( current ) )
+    shared_ptr<const CChildBoxes> retval = node->child_boxes();
+    if( ! retval )
+    {
+        shared_ptr<CChildBoxes> boxes = make_shared<CChildBoxes>( dim, node->child_nodes_id().size(),
+                                                                  at( node->child_nodes_id().front(), stats )->isData() );
+        for( const uint32_t child_node_id : node->child_nodes_id() )
+            boxes->add( child_node_id, * at( child_node_id, stats ) );
+
+        node->setChildBoxes( boxes );
+        cache.resized( node );
+        retval = boxes;
+    }
+    return retval;
+}
+
+uint32_t CRTree::height()
+{
+    uint32_t retval = 0;
+    for( shared_ptr<CNode> current = at( root_id ) ; ! current->isData() ; current = at( current->child_nodes_id().front() ) )
+        retval++;
+    return retval;
+}
+
+void CRTree::insertNode( const shared_ptr<CNode> & to_insert, const uint32_t level )
+{
+    if( insertion == HILBERT )
+    {
+        insertHilbert( to_insert, level );
+        return;
+    }
+
+    shared_ptr<CNode> destination = chooseLeaf( at( root_id ), height(), to_insert, level );
+
+    list<pair<shared_ptr<CNode>, uint32_t>> orphans;
+    shared_ptr<CNode> split_partner = nullptr;
+    const uint32_t count = destination->count();
+    // written before its parent, it is written again if the split moves it to the new node
+    to_insert->parent_id() = destination->id();
+    writeNode( to_insert );
+    destination->addChild( * to_insert );
+    if( destination->child_nodes_id().size() > MAX_CHILD_NODES && ! reinsert( destination, level, orphans ) )
+    {
+        pair<shared_ptr<CNode> &, shared_ptr<CNode> &>( destination, split_partner ) = split( destination );
+    }
+    adjustTree( destination, split_partner, count, level, orphans );
+
+    for( const auto & orphan : orphans )
+        insertNode( orphan.first, orphan.second );
+}
+
+shared_ptr<CNode> CRTree::chooseLeaf( shared_ptr<CNode> current, const uint32_t current_level,
+                                      const shared_ptr<CNode> to_insert, const uint32_t level )
+{
+    if( current_level == level )
         return current;
 
     double min_enlargement = DBL_MAX;
     double current_enlargement;
     shared_ptr<CNode> chosen_node = nullptr;
 
-    for( auto child_node_id : current->child_nodes_id() )
+    // the R*-tree minimizes the overlap only among leaves, it would be too costly higher
+    if( insertion == RSTAR && current_level == 2 )
+        chosen_node = chooseByOverlap( current, to_insert );
+    else for( auto child_node_id : current->child_nodes_id() )
     {
+        op_stats.compared++;
+
         current_enlargement = at( child_node_id )->enlargementWith( * to_insert );
 
         if( current_enlargement < min_enlargement )
@@ -222,132 +863,359 @@ shared_ptr<CNode> CRTree::chooseLeaf( shared_ptr<CNode> current, const shared_pt
         }
     }
 
-    parent_nodes.emplace( chosen_node->id(), current->id() );
-    return chooseLeaf( chosen_node, to_insert );
+    return chooseLeaf( chosen_node, current_level - 1, to_insert, level );
 }
 
-pair<shared_ptr<CNode>, shared_ptr<CNode>> CRTree::pickSeeds( list<uint32_t> & child_nodes_id )
+void CRTree::insertHilbert( const shared_ptr<CNode> & to_insert, const uint32_t level )
 {
-    pair<list<uint32_t>::const_iterator, list<uint32_t>::const_iterator> seeds_it;
-    shared_ptr<CNode> currentA, currentB;
-    double max_waste = -1;
-    double waste;
+    shared_ptr<CNode> node = at( root_id );
+    for( uint32_t current_level = height() ; current_level > level ; current_level-- )
+        node = chooseByKey( node, to_insert->lhv() );
+
+    to_insert->parent_id() = node->id();
+    writeNode( to_insert );
+    node->addChild( * to_insert );
 
-    for( auto it1 = child_nodes_id.begin() ; it1 != child_nodes_id.end() ; it1++ )
-        for( auto it2 = next( it1 ) ; it2 != child_nodes_id.end() ; it2++ )
+    // the changes are propagated to the root, overflows are shared with the siblings
+    shared_ptr<CNode> parent, created;
+    while( true )
+    {
+        if( node->child_nodes_id().size() <= MAX_CHILD_NODES )
         {
-            currentA = at( * it1 );
-            currentB = at( * it2 );
-            waste = merge( * currentA, * currentB ).volume() + currentA->volume() + currentB->volume();
-            if( waste > max_waste )
-            {
-                max_waste = waste;
-                seeds_it = make_pair( it1, it2 );
-            }
+            writeNode( node );
+            if( node->id() == root_id )
+                return;
+
+            parent = at( node->parent_id() );
+            parent->merge( * node );
+            parent->lhv() = max( parent->lhv(), node->lhv() );
+            parent->count() += to_insert->count();
+        }
+        else if( node->id() == root_id )
+        {
+            // the root has no sibling, it is split in halves under a new root
+            shared_ptr<CNode> root( new CNode( node->start(), node->dist(), allocate(), list<uint32_t>{} ) );
+            root_id = root->id();
+            node->parent_id() = root_id;
+
+            if( ( created = shareOverflow( root, node ) ) )
+                root->addChild( * created );
+            root->addChild( * node );
+            writeNode( root );
+            return;
+        }
+        else
+        {
+            parent = at( node->parent_id() );
+            if( ( created = shareOverflow( parent, node ) ) )
+                parent->addChild( * created );
+            tighten( parent );
         }
 
-    pair<shared_ptr<CNode>, shared_ptr<CNode>> retval = make_pair( at( * seeds_it.first ), at( * seeds_it.second ) );
-    child_nodes_id.erase( seeds_it.first );
-    child_nodes_id.erase( seeds_it.second );
-    return retval;
+        node = parent;
+    }
 }
 
+shared_ptr<CNode> CRTree::chooseByKey( const shared_ptr<CNode> & current, const uint64_t key )
+{
+    shared_ptr<CNode> child, covering, last;
+    op_stats.compared += current->child_nodes_id().size();
+    for( const uint32_t child_node_id : current->child_nodes_id() )
+    {
+        child = at( child_node_id );
+        if( child->lhv() >= key && ( ! covering || child->lhv() < covering->lhv() ) )
+            covering = child;
+        if( ! last || child->lhv() > last->lhv() )
+            last = child;
+    }
+    return covering ? covering : last;
+}
 
-shared_ptr<CNode> CRTree::pickNext( list<uint32_t> & child_nodes,
-                                    const shared_ptr<CNode> & nodeA,
-                                    const shared_ptr<CNode> & nodeB )
+shared_ptr<CNode> CRTree::shareOverflow( const shared_ptr<CNode> & parent, const shared_ptr<CNode> & node )
 {
-    list<uint32_t>::const_iterator picked_it;
-    double max_diff = -1;
-    double diff;
+    // the sibling following the node in the Hilbert order, or the preceding one if it is the last
+    shared_ptr<CNode> child, next, previous;
+    for( const uint32_t child_node_id : parent->child_nodes_id() )
+    {
+        if( child_node_id == node->id() )
+            continue;
+        child = at( child_node_id );
+        if( child->lhv() >= node->lhv() && ( ! next || child->lhv() < next->lhv() ) )
+            next = child;
+        if( child->lhv() < node->lhv() && ( ! previous || child->lhv() > previous->lhv() ) )
+            previous = child;
+    }
 
-    for( auto it = child_nodes.begin() ; it != child_nodes.end() ; it++ )
+    vector<shared_ptr<CNode>> nodes{ node };
+    if( next || previous )
+        nodes.push_back( next ? next : previous );
+
+    vector<shared_ptr<CNode>> children;
+    for( const auto & cooperating : nodes )
+        for( const uint32_t child_node_id : cooperating->child_nodes_id() )
+            children.push_back( at( child_node_id ) );
+    sort( children.begin(), children.end(), []( const shared_ptr<CNode> & a, const shared_ptr<CNode> & b )
     {
-        diff = abs( nodeA->enlargementWith( * at( * it ) ) - nodeB->enlargementWith( * at( * it ) ) );
-        if( diff > max_diff )
+        return a->lhv() < b->lhv();
+    } );
+
+    // the overfull node could not be encoded if the moved children flush the dirty nodes
+    for( const auto & cooperating : nodes )
+        cooperating->child_nodes_id().clear();
+
+    shared_ptr<CNode> created = nullptr;
+    if( children.size() > nodes.size() * MAX_CHILD_NODES )
+    {
+        created = make_shared<CNode>( node->start(), node->dist(), allocate(), list<uint32_t>{} );
+        created->parent_id() = parent->id();
+        nodes.push_back( created );
+        op_stats.splits++;
+    }
+
+    // the nodes keep the order of their Hilbert values
+    sort( nodes.begin(), nodes.end() - ( created ? 1 : 0 ), []( const shared_ptr<CNode> & a, const shared_ptr<CNode> & b )
+    {
+        return a->lhv() < b->lhv();
+    } );
+
+    size_t first = 0, size;
+    for( size_t i = 0 ; i < nodes.size() ; i++ )
+    {
+        size = children.size() / nodes.size() + ( i < children.size() % nodes.size() ? 1 : 0 );
+        assignChildren( nodes[i], children.begin() + first, children.begin() + first + size );
+        writeNode( nodes[i] );
+        first += size;
+    }
+
+    return created;
+}
+
+void CRTree::assignChildren( const shared_ptr<CNode> & node, vector<shared_ptr<CNode>>::const_iterator first,
+                             vector<shared_ptr<CNode>>::const_iterator last )
+{
+    node->child_nodes_id().clear();
+    node->start() = ( * first )->start();
+    node->dist() = ( * first )->dist();
+    node->lhv() = 0;
+    node->count() = 0;
+
+    for( auto it = first ; it != last ; it++ )
+    {
+        node->addChild( ** it );
+        if( ( * it )->parent_id() != node->id() )
         {
-            max_diff = diff;
-            picked_it = it;
+            ( * it )->parent_id() = node->id();
+            writeNode( * it );
         }
     }
+}
 
-    shared_ptr<CNode> retval = at( * picked_it );
-    child_nodes.erase( picked_it );
-    return retval;
+shared_ptr<CNode> CRTree::chooseByOverlap( const shared_ptr<CNode> & current, const shared_ptr<CNode> & to_insert )
+{
+    vector<shared_ptr<CNode>> children;
+    for( const uint32_t child_node_id : current->child_nodes_id() )
+        children.push_back( at( child_node_id ) );
+
+    // only the children enlarged the least are considered, ties are resolved by this order
+    vector<tuple<double, double, size_t>> candidates;
+    for( size_t i = 0 ; i < children.size() ; i++ )
+        candidates.emplace_back( children[i]->enlargementWith( * to_insert ), children[i]->volume(), i );
+    const size_t considered = min<size_t>( candidates.size(), OVERLAP_CANDIDATES );
+    op_stats.compared += children.size() + considered * ( children.size() - 1 );
+    partial_sort( candidates.begin(), candidates.begin() + considered, candidates.end() );
+
+    // the enlarged MBRs are stored in place for 2D and 3D trees
+    const size_t chosen = dispatchDimension( dim, [&]( auto geometry )
+    {
+        double min_overlap = DBL_MAX;
+        double overlap;
+        size_t chosen = get<2>( candidates.front() );
+
+        for( size_t c = 0 ; c < considered ; c++ )
+        {
+            const shared_ptr<CNode> & child = children[ get<2>( candidates[c] ) ];
+            typename CBox<decltype( geometry )::DIM>::type enlarged( * child );
+            enlarged.merge( * to_insert );
+
+            overlap = 0;
+            for( size_t i = 0 ; i < children.size() && overlap < min_overlap ; i++ )
+                if( i != get<2>( candidates[c] ) )
+                    overlap += enlarged.overlapVolume( * children[i] ) - child->overlapVolume( * children[i] );
+
+            if( overlap < min_overlap )
+            {
+                min_overlap = overlap;
+                chosen = get<2>( candidates[c] );
+            }
+        }
+        return chosen;
+    } );
+
+    return children[ chosen ];
 }
 
-pair<shared_ptr<CNode>, shared_ptr<CNode>> CRTree::split( const shared_ptr<CNode> & to_split )
+bool CRTree::reinsert( const shared_ptr<CNode> & node, const uint32_t level, list<pair<shared_ptr<CNode>, uint32_t>> & orphans )
 {
-    auto seeds = pickSeeds( to_split->child_nodes_id() );
-    shared_ptr<CNode> nodeA = make_shared<CNode>( CNode( seeds.first->start(), seeds.first->dist(), to_split->id(), list<uint32_t>{ seeds.first->id() } ) );
-    shared_ptr<CNode> nodeB = make_shared<CNode>( CNode( seeds.second->start(), seeds.second->dist(), next_id, list<uint32_t>{ seeds.second->id() } ) );
-    next_id++;
+    if( insertion != RSTAR || node->id() == root_id || ! reinserted_levels.insert( level ).second )
+        return false;
+
+    const size_t count = min<size_t>( node->child_nodes_id().size() * REINSERT_PERCENT / 100,
+                                      node->child_nodes_id().size() - MIN_CHILD_NODES );
+    if( count == 0 )
+        return false;
+
+    // children sorted by the squared distance of their centers from the center of the node
+    vector<pair<double, shared_ptr<CNode>>> children;
+    double distance, diff;
+    for( const uint32_t child_node_id : node->child_nodes_id() )
+    {
+        shared_ptr<CNode> child = at( child_node_id );
+        distance = 0;
+        for( unsigned i = 0 ; i < dim ; i++ )
+        {
+            diff = ( child->start()[i] + child->dist()[i] / 2 ) - ( node->start()[i] + node->dist()[i] / 2 );
+            distance += diff * diff;
+        }
+        children.emplace_back( distance, child );
+    }
+    sort( children.begin(), children.end(), []( const pair<double, shared_ptr<CNode>> & a, const pair<double, shared_ptr<CNode>> & b )
+    {
+        return a.first < b.first;
+    } );
+
+    node->child_nodes_id().clear();
+    for( size_t i = 0 ; i < children.size() - count ; i++ )
+        node->child_nodes_id().push_back( children[i].second->id() );
+    tighten( node );
+
+    // the closest of the removed children are reinserted first ("close reinsert")
+    for( size_t i = children.size() - count ; i < children.size() ; i++ )
+        orphans.push_back( make_pair( children[i].second, level ) );
 
-    if( to_split->id() != root_id )
-        parent_nodes.emplace( nodeB->id(), parent_nodes.at( to_split->id() ) );
+    return true;
+}
 
-    shared_ptr<CNode> next;
-    double nodeA_enlargement, nodeB_enlargement;
-    double nodeA_volume, nodeB_volume;
+void CRTree::condenseTree( shared_ptr<CNode> leaf )
+{
+    // orphaned nodes together with the level they have to be reinserted at
+    list<pair<shared_ptr<CNode>, uint32_t>> orphans;
 
-    while( ! to_split->child_nodes_id().empty() )
+    shared_ptr<CNode> current = leaf;
+    shared_ptr<CNode> parent;
+    uint32_t level = 1;
+
+    while( current->id() != root_id )
     {
+        parent = at( current->parent_id() );
 
-        if( nodeA->child_nodes_id().size() + to_split->child_nodes_id().size() == CNode::MIN_CHILD_NODES )
+        // the only child of the root is kept, the root is shrunk below instead
+        if( current->child_nodes_id().size() < MIN_CHILD_NODES
+            && ( parent->id() != root_id || parent->child_nodes_id().size() > 1 ) )
         {
-            for( auto id : to_split->child_nodes_id() )
-                nodeA->addChild( * at( id ) );
-            break;
+            parent->child_nodes_id().remove( current->id() );
+            for( const uint32_t child_node_id : current->child_nodes_id() )
+                orphans.push_back( make_pair( at( child_node_id ), level ) );
+            release( current->id() );
         }
-        else if( nodeB->child_nodes_id().size() + to_split->child_nodes_id().size() == CNode::MIN_CHILD_NODES )
+        else
         {
-            for( auto id : to_split->child_nodes_id() )
-                nodeB->addChild( * at( id ) );
-            break;
+            tighten( current );
+            writeNode( current );
         }
 
-        next = pickNext( to_split->child_nodes_id(), nodeA, nodeB );
+        current = parent;
+        level++;
+    }
+
+    if( current->child_nodes_id().empty() )
+    {
+        next_id = 1;
+        root_id = CNode::NULL_ID;
+        free_ids.clear();
+        cache.clear();
+        return;
+    }
 
-        nodeA_enlargement = nodeA->enlargementWith( * next );
-        nodeB_enlargement = nodeB->enlargementWith( * next );
-        if( nodeA_enlargement < nodeB_enlargement )
+    tighten( current );
+    writeNode( current );
+
+    for( const auto & orphan : orphans )
+        insertNode( orphan.first, orphan.second );
+
+    shared_ptr<CNode> root = at( root_id );
+    if( root->child_nodes_id().size() == 1 && ! isLeaf( root ) )
+    {
+        while( root->child_nodes_id().size() == 1 && ! isLeaf( root ) )
         {
-            nodeA->addChild( * next );
+            release( root->id() );
+            root = at( root->child_nodes_id().front() );
         }
-        else if( nodeA_enlargement == nodeB_enlargement )
+        root_id = root->id();
+        root->parent_id() = CNode::NULL_ID;
+        writeNode( root );
+    }
+}
+
+void CRTree::tighten( const shared_ptr<CNode> & node )
+{
+    shared_ptr<CNode> child = at( node->child_nodes_id().front() );
+    node->start() = child->start();
+    node->dist() = child->dist();
+    node->lhv() = 0;
+    node->count() = 0;
+    for( const uint32_t child_node_id : node->child_nodes_id() )
+    {
+        child = at( child_node_id );
+        node->merge( * child );
+        node->lhv() = max( node->lhv(), child->lhv() );
+        node->count() += child->count();
+    }
+}
+
+pair<shared_ptr<CNode>, shared_ptr<CNode>> CRTree::split( const shared_ptr<CNode> & to_split )
+{
+    vector<shared_ptr<CNode>> children;
+    vector<const CHyperrectangle *> boxes;
+    for( const uint32_t child_node_id : to_split->child_nodes_id() )
+    {
+        children.push_back( at( child_node_id ) );
+        boxes.push_back( children.back().get() );
+    }
+
+    const uint32_t min_size = max<uint32_t>( min<uint32_t>( MIN_CHILD_NODES, children.size() / 2 ), 1 );
+    vector<bool> second = splitter->split( boxes, min_size );
+    op_stats.splits++;
+    op_stats.compared += children.size();
+
+    // the nodes start as the MBRs of their first children
+    shared_ptr<CNode> nodes[2];
+    const uint32_t partner_id = allocate();
+    for( size_t i = 0 ; i < children.size() ; i++ )
+    {
+        if( ! nodes[ second[i] ] )
         {
-            nodeA_volume = nodeA->volume();
-            nodeB_volume = nodeB->volume();
-            if( nodeA_volume < nodeB_volume )
-            {
-                nodeA->addChild( * next );
-            }
-            else if( nodeA_volume == nodeB_volume )
-            {
-                if( nodeA->child_nodes_id().size() <= nodeB->child_nodes_id().size() )
-                {
-                    nodeA->addChild( * next );
-                }
-                else
-                {
-                    nodeB->addChild( * next );
-                }
-            }
-            else
-            {
-                nodeB->addChild( * next );
-            }
+            nodes[ second[i] ] = make_shared<CNode>( CNode( children[i]->start(), children[i]->dist(), second[i] ? partner_id : to_split->id(), list<uint32_t>{} ) );
+            nodes[ second[i] ]->parent_id() = to_split->parent_id();
         }
-        else
+        nodes[ second[i] ]->addChild( * children[i] );
+    }
+
+    // the overfull node could not be encoded if the writes below flush the dirty nodes
+    to_split->child_nodes_id().clear();
+
+    // the children of the new node have to store its id
+    for( size_t i = 0 ; i < children.size() ; i++ )
+        if( second[i] )
         {
-            nodeB->addChild( * next );
+            children[i]->parent_id() = nodes[1]->id();
+            writeNode( children[i] );
         }
-    }
 
-    return make_pair( nodeA, nodeB );
+    return make_pair( nodes[0], nodes[1] );
 }
 
-void CRTree::adjustTree( shared_ptr<CNode> current, shared_ptr<CNode> split_partner )
+void CRTree::adjustTree( shared_ptr<CNode> current, shared_ptr<CNode> split_partner, uint32_t count, uint32_t level,
+                         list<pair<shared_ptr<CNode>, uint32_t>> & orphans )
 {
     writeNode( current );
     if( split_partner )
@@ -357,13 +1225,19 @@ void CRTree::adjustTree( shared_ptr<CNode> current, shared_ptr<CNode> split_part
 
     while( current->id() != root_id )
     {
-        parent = at( parent_nodes.at( current->id() ) );
+        parent = at( current->parent_id() );
         parent->merge( * current );
+        // the count of current as the parent knows it is replaced by the new one
+        const uint32_t parent_count = parent->count();
+        parent->count() = parent->count() - count + current->count();
+        count = parent_count;
+        level++;
 
         if( split_partner )
         {
             parent->merge( * split_partner );
-            if( ! parent->addChild( * split_partner ) )
+            parent->addChild( * split_partner );
+            if( parent->child_nodes_id().size() > MAX_CHILD_NODES && ! reinsert( parent, level, orphans ) )
             {
                 pair<shared_ptr<CNode> &, shared_ptr<CNode> &> ( current, split_partner ) = split( parent );
             }
@@ -387,9 +1261,13 @@ void CRTree::adjustTree( shared_ptr<CNode> current, shared_ptr<CNode> split_part
     if( split_partner )
     {
         CHyperrectangle merged = merge( * current, * split_partner );
-        shared_ptr<CNode> root( new CNode( merged.start(), merged.dist(), next_id, list<uint32_t>{ current->id(), split_partner->id() } ) );
-        next_id++;
+        shared_ptr<CNode> root( new CNode( merged.start(), merged.dist(), allocate(), list<uint32_t>{ current->id(), split_partner->id() } ) );
+        root->count() = current->count() + split_partner->count();
         root_id = root->id();
+        current->parent_id() = root_id;
+        split_partner->parent_id() = root_id;
+        writeNode( current );
+        writeNode( split_partner );
         writeNode( root );
     }
 
@@ -397,70 +1275,326 @@ void CRTree::adjustTree( shared_ptr<CNode> current, shared_ptr<CNode> split_part
 
 void CRTree::writeNode( const shared_ptr<CNode> node )
 {
-    cache.at( node->id() % CACHE_SIZE ) = node;
+    // the boxes of the children and the box of the node in its parent may have changed
+    node->setChildBoxes( nullptr );
+    if( node->parent_id() != CNode::NULL_ID )
+        if( shared_ptr<CNode> parent = cache.peek( node->parent_id() ) )
+        {
+            parent->setChildBoxes( nullptr );
+            cache.resized( parent );
+        }
+
+    if( write_back )
+    {
+        cache.put( node, true );
+        // the dirty nodes cannot be evicted, so they are written once they fill the cache
+        if( cache.dirtyBytes() > cache.budget() )
+            writeDirty();
+        return;
+    }
 
-    file.seekp( HEADER_SIZE + ( node->id() - 1 ) * NODE_SIZE );
+    cache.put( node );
 
-    file.write( ( char * ) & node->id(), sizeof( node->id() ) );
+    node_buffer.resize( NODE_SIZE );
+    encodeNode( * node, node_buffer.data() );
+    storage->write( offset( node->id() ), node_buffer.data(), NODE_SIZE );
 
-    for( const double x : node->start() )
-        file.write( ( char * ) & x, sizeof( x ) );
-    for( const double x : node->dist() )
-        file.write( ( char * ) & x, sizeof( x ) );
+    op_stats.writes++;
+    op_stats.bytes_written += NODE_SIZE;
+}
 
-    file.write( ( char * ) & node->data_object_id(), sizeof( node->data_object_id() ) );
-    for( const uint32_t child_node_id : node->child_nodes_id() )
-        file.write( ( char * ) & child_node_id, sizeof( child_node_id ) );
-    for( unsigned i = 0 ; i < CNode::MAX_CHILD_NODES - node->child_nodes_id().size() ; i++ )
-        file.write( ( char * ) & CNode::NULL_ID, sizeof( CNode::NULL_ID ) );
+void CRTree::writeDirty()
+{
+    vector<shared_ptr<CNode>> nodes = cache.dirtyNodes();
+
+    size_t last;
+    for( size_t first = 0 ; first < nodes.size() ; first = last )
+    {
+        last = first + 1;
+        while( last < nodes.size() && last - first < MAX_WRITE_RUN && nodes[last]->id() == nodes[last - 1]->id() + 1 )
+            last++;
+
+        node_buffer.resize( ( last - first ) * NODE_SIZE );
+        for( size_t i = first ; i < last ; i++ )
+            encodeNode( * nodes[i], node_buffer.data() + ( i - first ) * NODE_SIZE );
+        storage->write( offset( nodes[first]->id() ), node_buffer.data(), node_buffer.size() );
+
+        op_stats.writes += last - first;
+        op_stats.bytes_written += node_buffer.size();
+    }
 
-    if( file.bad() ) throw runtime_error( "\"" + pr_name + "\"" + " is corrupted" );
+    cache.markClean();
+    uncommitted = 0;
+}
 
-    last_op_io++;
+void CRTree::commit()
+{
+    uncommitted++;
+    if( write_back && commit_interval && uncommitted >= commit_interval )
+        writeDirty();
 }
 
 shared_ptr<CNode> CRTree::readNode( const uint32_t id )
 {
-    CNode node;
+    // the node is decoded directly from the mapped file if the storage supports it
+    vector<char> buffer;
+    const char * data = storage->view( offset( id ), NODE_SIZE );
+    if( ! data )
+    {
+        buffer.resize( NODE_SIZE );
+        storage->read( offset( id ), buffer.data(), NODE_SIZE );
+        data = buffer.data();
+    }
 
-    uint32_t tmp_u;
-    double tmp_d;
+    return decodeNode( data );
+}
+
+// maps the double to an unsigned integer of the same order
+static uint64_t orderedBits( const double x )
+{
+    uint64_t bits;
+    memcpy( & bits, & x, sizeof( bits ) );
+    return bits >> 63 ? ~ bits : bits | ( 1ull << 63 );
+}
 
-    file.seekg( HEADER_SIZE + ( id - 1 ) * NODE_SIZE );
+uint64_t CRTree::hilbertKey( const CHyperrectangle & box ) const
+{
+    const unsigned bits = 64 / dim;
+    vector<uint64_t> x( dim );
+    for( unsigned i = 0 ; i < dim ; i++ )
+        x[i] = orderedBits( box.start()[i] + box.dist()[i] / 2 ) >> ( 64 - bits );
 
-    file.read( ( char * ) & node.id(), sizeof( node.id() ) );
+    // Skilling's transform of the coordinates to the transposed Hilbert index
+    const uint64_t high = 1ull << ( bits - 1 );
+    uint64_t t;
+    for( uint64_t q = high ; q > 1 ; q >>= 1 )
+        for( unsigned i = 0 ; i < dim ; i++ )
+        {
+            if( x[i] & q )
+                x[0] ^= q - 1;
+            else
+            {
+                t = ( x[0] ^ x[i] ) & ( q - 1 );
+                x[0] ^= t;
+                x[i] ^= t;
+            }
+        }
 
+    for( unsigned i = 1 ; i < dim ; i++ )
+        x[i] ^= x[i - 1];
+    t = 0;
+    for( uint64_t q = high ; q > 1 ; q >>= 1 )
+        if( x[ dim - 1 ] & q )
+            t ^= q - 1;
     for( unsigned i = 0 ; i < dim ; i++ )
+        x[i] ^= t;
+
+    // the bits of the axes interleaved from the most significant ones
+    uint64_t key = 0;
+    for( int b = bits - 1 ; b >= 0 ; b-- )
+        for( unsigned i = 0 ; i < dim ; i++ )
+            key = key << 1 | ( ( x[i] >> b ) & 1 );
+    return key;
+}
+
+uint64_t CRTree::recordSize( const uint32_t dim, const uint32_t max_child_nodes, const Encoding encoding )
+{
+    // id, parent id, LHV, count, MBR and data object id
+    const uint64_t fixed = 2 * ( uint64_t ) dim * sizeof( double ) + 4 * sizeof( uint32_t ) + sizeof( uint64_t );
+
+    // a compact node has flags, the number of children and a quantized MBR for every child
+    if( encoding == COMPACT )
+        return fixed + sizeof( uint8_t ) + sizeof( uint32_t ) + max_child_nodes * ( sizeof( uint32_t ) + 2 * dim * sizeof( uint16_t ) );
+    return fixed + max_child_nodes * sizeof( uint32_t );
+}
+
+uint32_t CRTree::pageFanout( const uint32_t dim, const PageSize page_size, const Encoding encoding )
+{
+    if( page_size != PAGE_4K && page_size != PAGE_8K && page_size != PAGE_16K )
+        throw logic_error( "Unsupported page size." );
+
+    const uint64_t fixed = recordSize( dim, 0, encoding );
+    const uint64_t child = recordSize( dim, 1, encoding ) - fixed;
+    if( fixed + 4 * child > page_size )
+        throw logic_error( "Nodes of dimension " + to_string( dim ) + " do not fit into a page of " + to_string( page_size ) + " bytes." );
+
+    return ( page_size - fixed ) / child;
+}
+
+uint64_t CRTree::offset( const uint32_t id ) const
+{
+    if( page_size )
+        return ( uint64_t ) id * page_size;
+    return HEADER_SIZE + ( uint64_t )( id - 1 ) * NODE_SIZE;
+}
+
+void CRTree::encodeNode( const CNode & node, char * buffer, const vector<shared_ptr<CNode>> * nodes ) const
+{
+    char * const begin = buffer;
+
+    writeValue( buffer, node.id() );
+    writeValue( buffer, node.parent_id() );
+    writeValue( buffer, node.lhv() );
+    writeValue( buffer, node.count() );
+
+    memcpy( buffer, node.start().data(), dim * sizeof( double ) );
+    buffer += dim * sizeof( double );
+    memcpy( buffer, node.dist().data(), dim * sizeof( double ) );
+    buffer += dim * sizeof( double );
+
+    writeValue( buffer, node.data_object_id() );
+
+    if( encoding == COMPACT )
     {
-        file.read( ( char * ) & tmp_d, sizeof( tmp_d ) );
-        node.start().push_back( tmp_d );
+        // the children are stored without boxes if they cannot be quantized
+        vector<uint16_t> quantized;
+        bool data = false;
+        uint8_t flags = 0;
+        if( ! node.isData() && quantizeChildren( node, quantized, data, nodes ) )
+            flags = CHILD_BOXES | ( data ? DATA_CHILDREN : 0 );
+
+        writeValue( buffer, flags );
+        writeValue( buffer, ( uint32_t ) node.child_nodes_id().size() );
+        for( const uint32_t child_node_id : node.child_nodes_id() )
+            writeValue( buffer, child_node_id );
+        if( ! quantized.empty() )
+        {
+            memcpy( buffer, quantized.data(), quantized.size() * sizeof( uint16_t ) );
+            buffer += quantized.size() * sizeof( uint16_t );
+        }
     }
-    for( unsigned i = 0 ; i < dim ; i++ )
+    else
+    {
+        for( const uint32_t child_node_id : node.child_nodes_id() )
+            writeValue( buffer, child_node_id );
+        for( unsigned i = 0 ; i < MAX_CHILD_NODES - node.child_nodes_id().size() ; i++ )
+            writeValue( buffer, CNode::NULL_ID );
+    }
+
+    memset( buffer, 0, NODE_SIZE - ( buffer - begin ) );
+}
+
+// the value q of a quantized interval [ start, start + dist ]
+static double dequantize( const double start, const double dist, const uint16_t q )
+{
+    return q == UINT16_MAX ? start + dist : start + dist * ( q / ( double ) UINT16_MAX );
+}
+
+bool CRTree::quantizeChildren( const CNode & node, vector<uint16_t> & quantized, bool & data,
+                               const vector<shared_ptr<CNode>> * nodes ) const
+{
+    quantized.clear();
+    quantized.reserve( 2 * dim * node.child_nodes_id().size() );
+
+    shared_ptr<CNode> child;
+    double low, high, start, dist;
+    int64_t q_low, q_high;
+    for( const uint32_t child_node_id : node.child_nodes_id() )
     {
-        file.read( ( char * ) & tmp_d, sizeof( tmp_d ) );
-        node.dist().push_back( tmp_d );
+        // the encoding never reads the file
+        if( nodes )
+            child = ( * nodes )[ child_node_id - 1 ];
+        else if( ! ( child = cache.peek( child_node_id ) ) )
+            return false;
+        data = child->isData();
+
+        for( unsigned i = 0 ; i < dim ; i++ )
+        {
+            start = node.start()[i];
+            dist = node.dist()[i];
+            low = child->start()[i];
+            high = child->start()[i] + child->dist()[i];
+
+            q_low = dist > 0 ? ( int64_t ) floor( ( low - start ) / dist * UINT16_MAX ) : 0;
+            q_high = dist > 0 ? ( int64_t ) ceil( ( high - start ) / dist * UINT16_MAX ) : UINT16_MAX;
+            q_low = min<int64_t>( max<int64_t>( q_low, 0 ), UINT16_MAX );
+            q_high = min<int64_t>( max<int64_t>( q_high, 0 ), UINT16_MAX );
+
+            // the dequantized interval has to enclose the child despite rounding
+            while( q_low > 0 && dequantize( start, dist, q_low ) > low )
+                q_low--;
+            while( q_high < UINT16_MAX && dequantize( start, dist, q_high ) < high )
+                q_high++;
+            if( dequantize( start, dist, q_low ) > low || dequantize( start, dist, q_high ) < high )
+                return false;
+
+            quantized.push_back( q_low );
+            quantized.push_back( q_high );
+        }
     }
 
-    file.read( ( char * ) & tmp_u, sizeof ( tmp_u ) );
+    return true;
+}
+
+shared_ptr<CNode> CRTree::decodeNode( const char * buffer ) const
+{
+    shared_ptr<CNode> node = make_shared<CNode>();
+
+    uint32_t tmp_u;
+
+    readValue( buffer, node->id() );
+    readValue( buffer, node->parent_id() );
+    readValue( buffer, node->lhv() );
+    readValue( buffer, node->count() );
+
+    node->start().resize( dim );
+    memcpy( node->start().data(), buffer, dim * sizeof( double ) );
+    buffer += dim * sizeof( double );
+    node->dist().resize( dim );
+    memcpy( node->dist().data(), buffer, dim * sizeof( double ) );
+    buffer += dim * sizeof( double );
+
+    readValue( buffer, tmp_u );
     if( tmp_u != 0 )
     {
-        node.data_object_id() = tmp_u;
+        node->data_object_id() = tmp_u;
+    }
+    else if( encoding == COMPACT )
+    {
+        uint8_t flags;
+        uint32_t count;
+        readValue( buffer, flags );
+        readValue( buffer, count );
+        if( count > MAX_CHILD_NODES ) throw runtime_error( "\"" + pr_name + "\" is corrupted." );
+
+        for( unsigned i = 0 ; i < count ; i++ )
+        {
+            readValue( buffer, tmp_u );
+            node->child_nodes_id().push_back( tmp_u );
+        }
+
+        // the boxes are valid until the node or one of its children is written
+        if( flags & CHILD_BOXES )
+        {
+            shared_ptr<CChildBoxes> boxes = make_shared<CChildBoxes>( dim, count, flags & DATA_CHILDREN, false );
+            vector<double> low( dim ), high( dim );
+            uint16_t q;
+            for( const uint32_t child_node_id : node->child_nodes_id() )
+            {
+                for( unsigned i = 0 ; i < dim ; i++ )
+                {
+                    readValue( buffer, q );
+                    low[i] = dequantize( node->start()[i], node->dist()[i], q );
+                    readValue( buffer, q );
+                    high[i] = dequantize( node->start()[i], node->dist()[i], q );
+                }
+                boxes->add( child_node_id, low.data(), high.data() );
+            }
+            node->setChildBoxes( boxes );
+        }
     }
     else
     {
-        for( unsigned i = 0 ; i < CNode::MAX_CHILD_NODES ; i++ )
+        for( unsigned i = 0 ; i < MAX_CHILD_NODES ; i++ )
         {
-            file.read( ( char * ) & tmp_u, sizeof( tmp_u ) );
+            readValue( buffer, tmp_u );
             if( tmp_u == CNode::NULL_ID )
                 break;
-            node.child_nodes_id().push_back( tmp_u );
+            node->child_nodes_id().push_back( tmp_u );
         }
     }
 
-    if( file.bad() ) throw runtime_error( "\"" + pr_name + "\"" + " is corrupted" );
-
-    last_op_io++;
-    return make_shared<CNode>( node );
+    return node;
 }
 
 void CRTree::retrieveUsedIds()
@@ -471,19 +1605,25 @@ void CRTree::retrieveUsedIds()
     queue<shared_ptr<CNode>> q;
     q.push( at( root_id ) );
     shared_ptr<CNode> current;
+    // the slots of the nodes which are not in the tree are free
+    vector<bool> used( next_id, false );
 
     while( ! q.empty() )
     {
         current = q.front();
         q.pop();
+        used[ current->id() ] = true;
 
         for( const uint32_t child_node_id : current->child_nodes_id() )
             q.push( at( child_node_id ) );
 
         if( current->isData() )
-            if( ! erased.count( current->data_object_id() ) )
-                data_object_ids_used.insert( current->data_object_id() );
+            data_object_ids_used.emplace( current->data_object_id(), current->id() );
     }
+
+    for( uint32_t id = 1 ; id < next_id ; id++ )
+        if( ! used[ id ] )
+            free_ids.insert( free_ids.end(), id );
 }
 
 uint32_t CRTree::getDim() const
@@ -491,128 +1631,558 @@ uint32_t CRTree::getDim() const
     return dim;
 }
 
+CRTree::Insertion CRTree::getInsertion() const { return insertion; }
+
+void CRTree::setSplit( const CSplitStrategy::Algorithm split_algorithm )
+{
+    unique_lock<shared_mutex> lock( tree_mutex );
+    splitter = CSplitStrategy::create( split_algorithm );
+}
+
+CSplitStrategy::Algorithm CRTree::getSplit() const { return splitter->algorithm(); }
+
+void CRTree::checkWritable() const
+{
+    if( read_only )
+        throw logic_error( "\"" + pr_name + "\" is opened read-only." );
+}
+
 void CRTree::save()
 {
-    file.seekp( 0 );
+    writeDirty();
+
+    // the header is padded to the whole first page
+    vector<char> header( max<uint32_t>( HEADER_SIZE, page_size ) );
+    char * buffer = header.data();
+
+    writeValue( buffer, dim );
+    writeValue( buffer, root_id );
+    writeValue( buffer, next_id );
+    writeValue( buffer, ERASED_MAX );
+    writeValue( buffer, CACHE_SIZE );
+    writeValue( buffer, MIN_CHILD_NODES );
+    writeValue( buffer, MAX_CHILD_NODES );
+    writeValue( buffer, CNode::NULL_ID );
+    writeValue( buffer, ( uint32_t ) insertion );
+    writeValue( buffer, ( uint32_t ) splitter->algorithm() );
+    writeValue( buffer, ( uint32_t ) page_size );
+    writeValue( buffer, ( uint32_t ) encoding );
+
+    storage->write( 0, header.data(), header.size() );
+
+    // deleted data objects are removed from the tree, so the list of erased ones stays empty
+    uint64_t erased_size = 0;
+    storage->write( offset( next_id ) + NODE_SIZE, ( char * ) & erased_size, sizeof( erased_size ) );
+    op_stats.bytes_written += header.size() + sizeof( erased_size );
+
+    // The id set follows: the magic, next_id, the number of the data objects, the number of the free
+    // slots, the pairs of the data object id and the id of its data node sorted by the data object id,
+    // the free slots and the checksum of all of it. The ids which were not loaded were not changed,
+    // so they are already written.
+    if( ids_loaded )
+    {
+        vector<pair<uint32_t, uint32_t>> ids( data_object_ids_used.begin(), data_object_ids_used.end() );
+        sort( ids.begin(), ids.end() );
+
+        const uint64_t size = ids.size(), free_size = free_ids.size();
+        vector<char> id_set( 2 * sizeof( uint32_t ) + sizeof( size ) + sizeof( free_size )
+                             + ( size * 2 + free_size ) * sizeof( uint32_t ) + sizeof( uint64_t ) );
+        buffer = id_set.data();
+        writeValue( buffer, ID_SET_MAGIC );
+        writeValue( buffer, next_id );
+        writeValue( buffer, size );
+        writeValue( buffer, free_size );
+        for( const auto & x : ids )
+        {
+            writeValue( buffer, x.first );
+            writeValue( buffer, x.second );
+        }
+        for( const uint32_t id : free_ids )
+            writeValue( buffer, id );
+        writeValue( buffer, checksum( id_set.data(), buffer - id_set.data() ) );
 
-    file.write( ( char * ) & dim, sizeof ( dim ) );
-    file.write( ( char * ) & root_id, sizeof ( root_id ) );
-    file.write( ( char * ) & next_id, sizeof ( next_id ) );
-    file.write( ( char * ) & ERASED_MAX, sizeof ( ERASED_MAX ) );
-    file.write( ( char * ) & CACHE_SIZE, sizeof ( CACHE_SIZE ) );
-    file.write( ( char * ) & CNode::MIN_CHILD_NODES, sizeof ( CNode::MIN_CHILD_NODES ) );
-    file.write( ( char * ) & CNode::MAX_CHILD_NODES, sizeof ( CNode::MAX_CHILD_NODES ) );
-    file.write( ( char * ) & CNode::NULL_ID, sizeof ( CNode::NULL_ID ) );
+        ids_offset = offset( next_id ) + NODE_SIZE + sizeof( erased_size );
+        storage->write( ids_offset, id_set.data(), id_set.size() );
+        op_stats.bytes_written += id_set.size();
+    }
 
-    file.seekp( HEADER_SIZE + next_id * NODE_SIZE );
-    uint64_t erased_size = erased.size();
-    file.write( ( char * ) & erased_size, sizeof( erased_size ) );
-    for( const auto id : erased )
-        file.write( ( char * ) & id, sizeof ( id ) );
+    storage->flush();
+}
 
-    if( file.bad() ) throw runtime_error( "Project could not be saved correctly." );
+unordered_map<uint32_t, uint32_t> & CRTree::usedIds()
+{
+    // the queries load the ids concurrently
+    if( ! ids_loaded.load( memory_order_acquire ) )
+    {
+        lock_guard<mutex> lock( ids_mutex );
+        if( ! ids_loaded.load( memory_order_relaxed ) )
+        {
+            if( ! readUsedIds() )
+                retrieveUsedIds();
+            ids_loaded.store( true, memory_order_release );
+        }
+    }
+    return data_object_ids_used;
 }
 
-void CRTree::rebuild()
+bool CRTree::readUsedIds()
+{
+    uint32_t magic, ids_next_id;
+    uint64_t size, free_size;
+    char fixed[ sizeof( magic ) + sizeof( ids_next_id ) + sizeof( size ) + sizeof( free_size ) ];
+    storage->read( ids_offset, fixed, sizeof( fixed ) );
+
+    const char * buffer = fixed;
+    readValue( buffer, magic );
+    readValue( buffer, ids_next_id );
+    readValue( buffer, size );
+    readValue( buffer, free_size );
+    if( magic != ID_SET_MAGIC || ids_next_id != next_id || size >= next_id || free_size >= next_id )
+        return false;
+
+    vector<char> id_set( sizeof( fixed ) + ( size * 2 + free_size ) * sizeof( uint32_t ) + sizeof( uint64_t ) );
+    storage->read( ids_offset, id_set.data(), id_set.size() );
+    op_stats.bytes_read += id_set.size();
+
+    uint64_t stored;
+    buffer = id_set.data() + id_set.size() - sizeof( stored );
+    readValue( buffer, stored );
+    if( stored != checksum( id_set.data(), id_set.size() - sizeof( stored ) ) )
+        return false;
+
+    data_object_ids_used.reserve( size );
+    buffer = id_set.data() + sizeof( fixed );
+    uint32_t data_object_id, node_id;
+    for( uint64_t i = 0 ; i < size ; i++ )
+    {
+        readValue( buffer, data_object_id );
+        readValue( buffer, node_id );
+        data_object_ids_used.emplace( data_object_id, node_id );
+    }
+    for( uint64_t i = 0 ; i < free_size ; i++ )
+    {
+        readValue( buffer, node_id );
+        free_ids.insert( free_ids.end(), node_id );
+    }
+    return true;
+}
+
+uint32_t CRTree::allocate()
 {
-    auto data_objects = search( at( root_id )->start(), at( root_id )->dist() );
+    if( free_ids.empty() )
+        return next_id++;
 
-    next_id = 1;
-    data_object_ids_used.clear();
-    cache = vector<shared_ptr<CNode>>( CACHE_SIZE, nullptr );
+    // the lowest slot, so the nodes gather at the start of the file
+    const uint32_t retval = * free_ids.begin();
+    free_ids.erase( free_ids.begin() );
+    return retval;
+}
+
+void CRTree::release( const uint32_t id )
+{
+    // the node is not written any more, even if it is dirty
+    cache.erase( id );
+    free_ids.insert( id );
+
+    // the free slots at the end are not kept, the file is truncated by compact
+    while( ! free_ids.empty() && * free_ids.rbegin() == next_id - 1 )
+    {
+        free_ids.erase( prev( free_ids.end() ) );
+        next_id--;
+    }
+}
+
+size_t CRTree::compact( const size_t max_moves )
+{
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+    checkWritable();
 
-    for( const auto data_object : data_objects )
-        if( ! erased.count( get<0>( data_object ) ) )
-            insert( get<0>( data_object ), get<1>( data_object ), get<2>( data_object ) );
+    // the data nodes moved have to be found in the map
+    usedIds();
 
-    erased.clear();
+    shared_ptr<CNode> node;
+    uint32_t id;
+    for( size_t moves = 0 ; moves < max_moves && ! free_ids.empty() ; moves++ )
+    {
+        // the last node moves to the first free slot, the end of the file is free then
+        node = at( next_id - 1 );
+        cache.erase( node->id() );
+        node->id() = allocate();
+        id = node->id();
+
+        // bottom-up, a compact node quantizes the MBRs of its children found in the cache
+        if( node->isData() )
+            data_object_ids_used[ node->data_object_id() ] = id;
+        else
+            for( const uint32_t child_node_id : node->child_nodes_id() )
+            {
+                shared_ptr<CNode> child = at( child_node_id );
+                child->parent_id() = id;
+                writeNode( child );
+            }
+
+        writeNode( node );
+
+        if( node->parent_id() == CNode::NULL_ID )
+            root_id = id;
+        else
+        {
+            shared_ptr<CNode> parent = at( node->parent_id() );
+            replace( parent->child_nodes_id().begin(), parent->child_nodes_id().end(), next_id - 1, id );
+            if( encoding == COMPACT )
+                for( const uint32_t child_node_id : parent->child_nodes_id() )
+                    at( child_node_id );
+            writeNode( parent );
+        }
+
+        release( next_id - 1 );
+    }
+
+    // the nodes past the end are not needed any more, save writes the id set after the last node
+    writeDirty();
+    storage->truncate( offset( next_id ) );
     save();
+
+    record( op_stats, started );
+    return free_ids.size();
 }
 
-bool sortByMinDist( const pair<uint32_t, double> & a, const pair<uint32_t, double> & b )
+void CRTree::rebuild()
 {
-    return a.second < b.second;
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    unique_lock<shared_mutex> lock( tree_mutex );
+    op_stats = CStats();
+    checkWritable();
+
+    pack( dataObjects() );
+    record( op_stats, started );
 }
 
-list<tuple<uint32_t, vector<double>, vector<double>>> CRTree::knn( const unsigned k, const vector<double> & query_point )
+CQuality CRTree::analyze( const double window )
 {
-    last_op_io = 0;
+    if( window < 0 )
+        throw logic_error( "The window cannot be negative." );
 
-    if( query_point.size() != dim )
-        throw logic_error( "Wrong dimension." );
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    shared_lock<shared_mutex> lock( tree_mutex );
+    CStats stats;
+    CQuality retval;
+    if( next_id == 1 )
+    {
+        record( stats, started );
+        return retval;
+    }
+
+    shared_ptr<CNode> root = at( root_id, stats );
+    stats.visit( 0 );
+    const vector<double> & extent = root->dist();
+    for( const double side : extent )
+        retval.window.push_back( side * window );
 
-    if( k > data_object_ids_used.size() )
-        throw logic_error( "There are " + to_string( data_object_ids_used.size() ) + " data objects in total, which is less then k." );
+    // probability that the window intersects the node, the dimensions in which the root is flat are skipped
+    auto accesses = [&]( const CNode & node )
+    {
+        double probability = 1;
+        for( uint32_t i = 0 ; i < dim ; i++ )
+            if( extent[i] > 0 )
+                probability *= min( 1.0, ( node.dist()[i] + retval.window[i] ) / extent[i] );
+        return probability;
+    };
+
+    // the levels are collected by their depth first, the root is at depth 0
+    vector<CLevelQuality> levels( 2 );
+    levels[0].nodes = 1;
+    levels[0].area = root->volume();
+    levels[0].margin = root->margin();
+    levels[0].accesses = accesses( * root );
+    levels[0].min_fill = levels[1].min_fill = DBL_MAX;
+
+    vector<uint32_t> current{ root_id }, next;
+    vector<shared_ptr<CNode>> children;
+    double covered, largest, overlap;
+    for( uint32_t depth = 0 ; ! current.empty() ; depth++ )
+    {
+        next.clear();
+        for( const uint32_t id : current )
+        {
+            shared_ptr<CNode> node = at( id, stats );
+            children.clear();
+            for( const uint32_t child_node_id : node->child_nodes_id() )
+            {
+                children.push_back( at( child_node_id, stats ) );
+                stats.visit( depth + 1 );
+            }
 
-    if( next_id == 1 || k == 0 )
-        return {};
+            CLevelQuality & level = levels[ depth ];
+            CLevelQuality & child_level = levels[ depth + 1 ];
+            const double fill = ( double ) children.size() / MAX_CHILD_NODES;
+            level.min_fill = min( level.min_fill, fill );
+            level.avg_fill += fill;
+
+            // the union of the children is at least the sum of their volumes minus the pairwise overlaps
+            // and at least the largest child
+            covered = 0;
+            largest = 0;
+            overlap = 0;
+            for( size_t i = 0 ; i < children.size() ; i++ )
+            {
+                covered += children[i]->volume();
+                largest = max( largest, children[i]->volume() );
+                for( size_t j = i + 1 ; j < children.size() ; j++ )
+                    overlap += children[i]->overlapVolume( * children[j] );
+
+                child_level.nodes++;
+                child_level.area += children[i]->volume();
+                child_level.margin += children[i]->margin();
+                child_level.accesses += accesses( * children[i] );
+                if( ! children[i]->isData() )
+                    next.push_back( children[i]->id() );
+            }
+            child_level.overlap += overlap;
+            level.dead_space += max( 0.0, node->volume() - max( covered - overlap, largest ) );
+        }
 
-    list<tuple<uint32_t, vector<double>, vector<double>>> res;
+        levels[ depth ].avg_fill /= levels[ depth ].nodes;
+        if( ! next.empty() )
+        {
+            levels.emplace_back();
+            levels.back().min_fill = DBL_MAX;
+        }
+        current.swap( next );
+    }
+
+    // the data nodes have no children
+    levels.back().min_fill = 0;
+
+    retval.levels.assign( levels.rbegin(), levels.rend() );
+    retval.height = retval.levels.size() - 1;
+    for( const auto & level : retval.levels )
+        retval.accesses += level.accesses;
+    for( uint32_t level = 1 ; level < retval.levels.size() ; level++ )
+        retval.nodes += retval.levels[ level ].nodes;
+
+    record( stats, started );
+    return retval;
+}
+
+list<tuple<uint32_t, vector<double>, vector<double>>> CRTree::dataObjects()
+{
+    list<tuple<uint32_t, vector<double>, vector<double>>> retval;
 
-    stack<shared_ptr<CNode>> s;
-    s.push( at( root_id ) );
+    if( next_id == 1 )
+        return retval;
 
+    queue<shared_ptr<CNode>> q;
+    q.push( at( root_id ) );
     shared_ptr<CNode> current;
-    priority_queue<shared_ptr<CNode>, vector<shared_ptr<CNode>>, CompareMindist> pq((CompareMindist( query_point )));
-    vector<pair<uint32_t, float>> res_id;
 
-    while( ! s.empty() )
+    while( ! q.empty() )
     {
-        current = s.top();
-        s.pop();
+        current = q.front();
+        q.pop();
+
+        for( const uint32_t child_node_id : current->child_nodes_id() )
+            q.push( at( child_node_id ) );
 
         if( current->isData() )
+            retval.push_back( make_tuple( current->data_object_id(), current->start(), current->dist() ) );
+    }
+
+    return retval;
+}
+
+void CRTree::pack( const list<tuple<uint32_t, vector<double>, vector<double>>> & data_objects )
+{
+    next_id = 1;
+    root_id = CNode::NULL_ID;
+    // all the ids are replaced, the old ones need not be loaded
+    data_object_ids_used.clear();
+    free_ids.clear();
+    ids_loaded = true;
+    cache.clear();
+
+    if( data_objects.empty() )
+    {
+        save();
+        return;
+    }
+
+    // all the nodes ordered by their ids, they are written once their parents are known
+    vector<shared_ptr<CNode>> nodes;
+    vector<shared_ptr<CNode>> level;
+    level.reserve( data_objects.size() );
+    for( const auto & data_object : data_objects )
+    {
+        shared_ptr<CNode> node( new CNode( get<1>( data_object ), get<2>( data_object ), next_id, get<0>( data_object ) ) );
+        node->lhv() = hilbertKey( * node );
+        next_id++;
+        data_object_ids_used.emplace( get<0>( data_object ), node->id() );
+        level.push_back( node );
+    }
+    nodes = level;
+
+    // at least one level of inner nodes is built, so the root is never a data node
+    do
+    {
+        vector<pair<vector<shared_ptr<CNode>>::iterator, vector<shared_ptr<CNode>>::iterator>> groups;
+        const size_t nodes_count = ( level.size() + MAX_CHILD_NODES - 1 ) / MAX_CHILD_NODES;
+        if( insertion == HILBERT )
         {
-            if( res_id.size() == k )
+            // runs of the nodes ordered by their Hilbert values, spread evenly
+            sort( level.begin(), level.end(), []( const shared_ptr<CNode> & a, const shared_ptr<CNode> & b )
             {
-                if( current->mindist( query_point ) <= res_id.back().second )
-                {
-                    res_id.pop_back();
-                    res_id.push_back( make_pair( current->id(), current->mindist( query_point ) ) );
-                    sort( res_id.begin(), res_id.end(), sortByMinDist );
-                }
-            }
-            else
+                return a->lhv() < b->lhv();
+            } );
+            auto first = level.begin();
+            for( size_t node = 0 ; node < nodes_count ; node++ )
             {
-                res_id.push_back( make_pair( current->id(), current->mindist( query_point ) ) );
-                sort( res_id.begin(), res_id.end(), sortByMinDist );
+                const size_t size = level.size() / nodes_count + ( node < level.size() % nodes_count ? 1 : 0 );
+                groups.push_back( make_pair( first, first + size ) );
+                first += size;
             }
-        }else
+        }
+        else
+            strTile( level.begin(), level.end(), nodes_count, 0, groups );
+
+        vector<shared_ptr<CNode>> parents;
+        parents.reserve( groups.size() );
+        for( const auto & group : groups )
         {
-            for( const uint32_t child_node_id : current->child_nodes_id() )
+            shared_ptr<CNode> parent( new CNode( ( * group.first )->start(), ( * group.first )->dist(), next_id ) );
+            next_id++;
+            for( auto it = group.first ; it != group.second ; it++ )
             {
-                if( res_id.size() == 0 || res_id.size() < k || at( child_node_id )->mindist( query_point ) <= res_id.back().second )
-                    pq.push( at( child_node_id ) );
+                parent->addChild( ** it );
+                ( * it )->parent_id() = parent->id();
             }
+            parents.push_back( parent );
+            nodes.push_back( parent );
+        }
+        level.swap( parents );
+    }
+    while( level.size() > 1 );
 
-            while( ! pq.empty() )
-            {
-                s.push( pq.top() );
-                pq.pop();
-            }
+    root_id = level.front()->id();
+
+    // The nodes are written by runs of consecutive ids. Their children are quantized from nodes,
+    // a level of inner nodes may not fit into the cache.
+    size_t last;
+    for( size_t first = 0 ; first < nodes.size() ; first = last )
+    {
+        last = min<size_t>( nodes.size(), first + MAX_WRITE_RUN );
+
+        node_buffer.resize( ( last - first ) * NODE_SIZE );
+        for( size_t i = first ; i < last ; i++ )
+        {
+            encodeNode( * nodes[i], node_buffer.data() + ( i - first ) * NODE_SIZE, & nodes );
+            cache.put( nodes[i] );
         }
+        storage->write( offset( nodes[first]->id() ), node_buffer.data(), node_buffer.size() );
+
+        op_stats.writes += last - first;
+        op_stats.bytes_written += node_buffer.size();
+    }
+
+    save();
+}
+
+void CRTree::strTile( vector<shared_ptr<CNode>>::iterator first, vector<shared_ptr<CNode>>::iterator last,
+                      const size_t nodes, const uint32_t axis,
+                      vector<pair<vector<shared_ptr<CNode>>::iterator, vector<shared_ptr<CNode>>::iterator>> & groups )
+{
+    if( nodes <= 1 )
+    {
+        groups.push_back( make_pair( first, last ) );
+        return;
+    }
+
+    sort( first, last, [axis]( const shared_ptr<CNode> & a, const shared_ptr<CNode> & b )
+    {
+        return 2 * a->start().at( axis ) + a->dist().at( axis ) < 2 * b->start().at( axis ) + b->dist().at( axis );
+    } );
+
+    // the entries are spread evenly among the nodes so that none of them is underfilled
+    size_t entries = last - first;
+    size_t slabs = axis + 1 == dim ? nodes : min( nodes, ( size_t ) ceil( pow( nodes, 1.0 / ( dim - axis ) ) ) );
+
+    size_t node = 0;
+    for( size_t slab = 0 ; slab < slabs ; slab++ )
+    {
+        size_t slab_nodes = nodes / slabs + ( slab < nodes % slabs ? 1 : 0 );
+        size_t slab_entries = 0;
+        for( size_t i = 0 ; i < slab_nodes ; i++, node++ )
+            slab_entries += entries / nodes + ( node < entries % nodes ? 1 : 0 );
+
+        if( axis + 1 == dim )
+            groups.push_back( make_pair( first, first + slab_entries ) );
+        else
+            strTile( first, first + slab_entries, slab_nodes, axis + 1, groups );
+        first += slab_entries;
     }
+}
+
+list<tuple<uint32_t, vector<double>, vector<double>>> CRTree::knn( const unsigned k, const vector<double> & query_point )
+{
+    list<tuple<uint32_t, vector<double>, vector<double>>> res;
 
-    for( auto nn : res_id )
-        res.push_back( make_tuple( at( nn.first )->data_object_id(), at( nn.first )->start(), at( nn.first )->dist() ) );
+    knn( k, query_point, [&res]( const CNode & data_node )
+    {
+        res.push_back( make_tuple( data_node.data_object_id(), data_node.start(), data_node.dist() ) );
+        return true;
+    } );
 
     return res;
 }
 
+unsigned CRTree::knn( const unsigned k, const vector<double> & query_point, const CDataVisitor & visitor )
+{
+    if( query_point.size() != dim )
+        throw logic_error( "Wrong dimension." );
+
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    shared_lock<shared_mutex> lock( tree_mutex );
+
+    // the root counts all the data objects, the id set does not have to be loaded
+    CStats stats;
+    const uint32_t total = next_id == 1 ? 0 : at( root_id, stats )->count();
+    if( k > total )
+        throw logic_error( "There are " + to_string( total ) + " data objects in total, which is less then k." );
+
+    CNearestCursor cursor( * this, query_point );
+    shared_ptr<const CNode> data_node;
+    for( unsigned i = 0 ; i < k && cursor.step( data_node ) ; i++ )
+        if( ! visitor( * data_node ) )
+            break;
+
+    stats += cursor.stats();
+    record( stats, started );
+    return stats.reads;
+}
+
+CNearestCursor CRTree::nearest( const vector<double> & query_point )
+{
+    if( query_point.size() != dim )
+        throw logic_error( "Wrong dimension." );
+
+    shared_lock<shared_mutex> lock( tree_mutex );
+    return CNearestCursor( * this, query_point );
+}
+
 ostream & operator<<( ostream & os, CRTree & rtree )
 {
+    // the free slots are loaded with the ids
+    rtree.usedIds();
     cout << "root id: " << rtree.root_id << endl;
-    cout << "CNode::MAX_CHILD_NODES: " << CNode::MAX_CHILD_NODES << endl;
-    cout << "CNode::MIN_CHILD_NODES: " << CNode::MIN_CHILD_NODES << endl;
+    cout << "MAX_CHILD_NODES: " << rtree.MAX_CHILD_NODES << endl;
+    cout << "MIN_CHILD_NODES: " << rtree.MIN_CHILD_NODES << endl;
     for( unsigned i = 1 ; i < rtree.next_id ; i++ )
-        os << * rtree.at( i ) << endl;
+        if( ! rtree.free_ids.count( i ) )
+            os << * rtree.at( i ) << endl;
     os << "data object ids used: ";
-    for( auto x : rtree.data_object_ids_used )
-        os << x << ", ";
-    os << endl;
-    os << "erased: ";
-    for( auto x : rtree.erased )
-        os << x << ", ";
+    for( auto x : rtree.usedIds() )
+        os << x.first << ", ";
     os << endl;
     return os;
 }
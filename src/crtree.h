@@ -3,6 +3,11 @@
 
 #include "chyperrectangle.h"
 #include "cnode.h"
+#include "cbufferpool.h"
+#include "cstorage.h"
+#include "csplitstrategy.h"
+#include "cthreadpool.h"
+#include "cpredicate.h"
 
 #include <list>
 #include <array>
@@ -11,107 +16,534 @@
 #include <memory>
 #include <limits>
 #include <float.h>
+#include <cmath>
 #include <unordered_map>
 #include <unordered_set>
+#include <set>
 #include <fstream>
 #include <queue>
 #include <stack>
 #include <tuple>
 #include <stdexcept>
 #include <algorithm>
+#include <functional>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <cstring>
 
 using namespace std;
 
-class CompareMindist
+class CRTree;
+
+// receives the data node of every result, the query stops when it returns false
+typedef function<bool( const CNode & data_node )> CDataVisitor;
+
+// called with the ids of two data objects whose MBRs overlap, the join stops if it returns false
+typedef function<bool( const uint32_t data_object_id, const uint32_t other_data_object_id )> CJoinVisitor;
+
+// What one or more operations did. The queries count the nodes they visit by their depth,
+// the root is at depth 0 and the data nodes at the greatest one (the join does not count them).
+struct CStats
+{
+    uint64_t operations = 0;
+    // wall time
+    double seconds = 0;
+    vector<uint64_t> visited;
+    // lookups of nodes in the buffer pool
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+    // nodes read from and written to the file, the bytes include the header
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    // overflowed nodes divided, including the 2-to-3 splits of the Hilbert R-tree
+    uint64_t splits = 0;
+    // entries compared with the query, with the entry being inserted or divided by the splits
+    uint64_t compared = 0;
+
+    void visit( const uint32_t depth );
+
+    CStats & operator+=( const CStats & other );
+};
+
+// Shape of the nodes of one level, the volumes are summed over the nodes. The data nodes are at
+// level 0, their fill and dead space are 0.
+struct CLevelQuality
+{
+    uint64_t nodes = 0;
+    // children per node relative to MAX_CHILD_NODES
+    double min_fill = 0;
+    double avg_fill = 0;
+    // volumes of the MBRs
+    double area = 0;
+    // volumes of the intersections of the pairs of nodes with the same parent
+    double overlap = 0;
+    // volumes of the MBRs not covered by their children, estimated from the pairs of children
+    double dead_space = 0;
+    // sums of the edge lengths
+    double margin = 0;
+    // expected number of the nodes read by a query intersecting the window, see CRTree::analyze
+    double accesses = 0;
+};
+
+struct CQuality
+{
+    // of the root, 0 if the tree is empty
+    uint32_t height = 0;
+    // without the data nodes
+    uint64_t nodes = 0;
+    // the sides of the window of the estimated accesses
+    vector<double> window;
+    double accesses = 0;
+    // indexed by the level
+    vector<CLevelQuality> levels;
+};
+
+// aggregate statistics of a batch of queries
+struct CBatchStats
+{
+    size_t queries;
+    uint64_t results;
+    // nodes read from the file by all the queries and by the most expensive one
+    uint64_t io;
+    uint64_t max_io;
+    // wall time of the whole batch, the sum and the maximum of the times of the queries
+    double seconds;
+    double query_seconds;
+    double max_query_seconds;
+};
+
+// Yields the data objects ordered by their distance from the query point using the best-first
+// search of Hjaltason and Samet. The tree must not be modified while the cursor is in use,
+// but it can be queried by other threads.
+class CNearestCursor
 {
 public:
-    CompareMindist( const vector<double> & point );
+    // returns false if all the data objects were already returned
+    bool next( tuple<uint32_t, vector<double>, vector<double>> & data_object );
+
+    // the same without copying the data object
+    bool next( shared_ptr<const CNode> & data_node );
+
+    // squared distance of the data object returned by the last call of next
+    double distance() const;
+
+    // everything the cursor did so far
+    const CStats & stats() const;
 
-    bool operator() ( shared_ptr<CNode> a, shared_ptr<CNode> b ) const;
 private:
-    const vector<double> & point;
+    friend class CRTree;
+
+    CNearestCursor( CRTree & rtree, const vector<double> & query_point );
+
+    // next without locking the tree
+    bool step( shared_ptr<const CNode> & data_node );
+
+    struct CEntry
+    {
+        double mindist;
+        uint32_t id;
+        uint32_t depth;
+        bool data;
+        // false if mindist is only a lower bound of the distance of the data node
+        bool exact;
+        // the data node was already counted in the stats
+        bool visited;
+
+        bool operator>( const CEntry & other ) const;
+    };
+
+    CRTree * rtree;
+    vector<double> query_point;
+    priority_queue<CEntry, vector<CEntry>, greater<CEntry>> entries;
+    vector<double> mindists;
+    double distance_;
+    CStats stats_;
 };
 
-
+// Queries (search, knn and the cursors) can run concurrently from any number of threads,
+// modifications wait until no query is running and vice versa.
 class CRTree
 {
 public:
+    // GUTTMAN is the original R-tree, RSTAR the R*-tree of Beckmann et al., HILBERT the Hilbert
+    // R-tree of Kamel and Faloutsos (at most 64 dimensions), which also packs by Hilbert values
+    enum Insertion { GUTTMAN, RSTAR, HILBERT };
+
+    // PACKED stores the nodes one after another, the other formats give every node one aligned page
+    enum PageSize { PACKED = 0, PAGE_4K = 4096, PAGE_8K = 8192, PAGE_16K = 16384 };
+
+    // COMPACT nodes also store the MBRs of their children quantized relative to their own MBR,
+    // so the queries read only the children that can match (the data nodes keep exact MBRs)
+    enum Encoding { PLAIN, COMPACT };
+
+    // erased_max is only kept for the compatibility of the file format, deleted data objects
+    // are removed from the tree immediately
     CRTree( const string & pr_name, const uint32_t dim,
             const uint32_t min_child_nodes, const uint32_t max_child_nodes,
-            const uint32_t cache_size, const uint32_t erased_max );
-
-    CRTree( const string & pr_name );
+            const uint32_t cache_size, const uint32_t erased_max,
+            const CStorage::Backend backend = CStorage::STREAM,
+            const Insertion insertion = GUTTMAN,
+            const CSplitStrategy::Algorithm split_algorithm = CSplitStrategy::QUADRATIC,
+            const Encoding encoding = PLAIN );
+
+    // Every node occupies one page, so a node is read by a single aligned read (see CStorage::DIRECT).
+    // The fanout is derived from the page size and the dimension.
+    CRTree( const string & pr_name, const uint32_t dim, const PageSize page_size,
+            const uint32_t cache_size,
+            const CStorage::Backend backend = CStorage::STREAM,
+            const Insertion insertion = GUTTMAN,
+            const CSplitStrategy::Algorithm split_algorithm = CSplitStrategy::QUADRATIC,
+            const Encoding encoding = PLAIN );
+
+    // A read-only tree cannot be modified and the file is not written when it is closed,
+    // so it can be inspected (see analyze) without changing it.
+    CRTree( const string & pr_name, const CStorage::Backend backend = CStorage::STREAM, const bool read_only = false );
 
     ~CRTree();
 
     void insert( const uint32_t id, const vector<double> & start, const vector<double> & dist );
 
+    // Builds a packed tree using Sort-Tile-Recursive packing. Data objects that are already
+    // in the tree are packed together with the new ones.
+    void bulkLoad( const list<tuple<uint32_t, vector<double>, vector<double>>> & data_objects );
+
+    // the data objects lying within the window, see CPredicate::within
     list<tuple<uint32_t, vector<double>, vector<double>>> search( const vector<double> & start, const vector<double> & dist );
+
+    unsigned search( const vector<double> & start, const vector<double> & dist, const CDataVisitor & visitor );
+
+    size_t count( const vector<double> & start, const vector<double> & dist );
+
+    // the data objects matching the predicate
+    list<tuple<uint32_t, vector<double>, vector<double>>> search( const CPredicate & predicate );
+
+    // Streams the results to the visitor without materializing them. Returns the number of
+    // nodes read from the file.
+    unsigned search( const CPredicate & predicate, const CDataVisitor & visitor );
+
+    // Number of the data objects search would return. The subtrees covered by the predicate
+    // (lying within the window) are counted by the counts stored in their roots, without
+    // descending into them.
+    size_t count( const CPredicate & predicate );
 	
 	list<tuple<uint32_t, vector<double>, vector<double>>> knn( const unsigned k, const vector<double> & quary_pint );
 
+    // streams the k nearest neighbours to the visitor ordered by their distance, see search
+    unsigned knn( const unsigned k, const vector<double> & query_point, const CDataVisitor & visitor );
+
+    // nearest neighbours of the point, see CNearestCursor
+    CNearestCursor nearest( const vector<double> & query_point );
+
+    // Runs the window queries given by their start and dist in parallel, the i-th list holds
+    // the results of the i-th query. The statistics are filled in if stats is not nullptr.
+    vector<list<tuple<uint32_t, vector<double>, vector<double>>>> searchBatch( const vector<pair<vector<double>, vector<double>>> & queries,
+                                                                               CBatchStats * stats = nullptr );
+
+    // the same for the k nearest neighbours of every point
+    vector<list<tuple<uint32_t, vector<double>, vector<double>>>> knnBatch( const unsigned k, const vector<vector<double>> & query_points,
+                                                                            CBatchStats * stats = nullptr );
+
+    // threads running the batches including the calling one, hardware concurrency by default
+    void setBatchThreads( const unsigned threads );
+
+    // Spatial join by the synchronized traversal of Brinkhoff, Kriegel and Seeger: calls the visitor
+    // for every pair of a data object of this tree and one of the other tree whose MBRs overlap.
+    // Disjoint pairs of subtrees are joined in parallel by the batch threads, the visitor is called
+    // by one thread at a time. Returns the number of nodes read from both files.
+    unsigned join( CRTree & other, const CJoinVisitor & visitor );
+
     void erase( const uint32_t id );
 
+    // repacks the whole tree, see bulkLoad
+    void rebuild();
+
+    // The slots of the erased nodes are reused by the new ones. Moves at most max_moves nodes from
+    // the end of the file to the free slots, then truncates the file after the last node. Returns
+    // the number of the free slots left, the file is compact when it is 0.
+    size_t compact( const size_t max_moves = SIZE_MAX );
+
+    // Reads the whole tree and describes the shape of its levels. The accesses are estimated by the
+    // model of Kamel and Faloutsos: a node is read if it intersects the window whose center is uniformly
+    // distributed over the MBR of the root, the sides of the window are the fraction window of its sides.
+    // The quality can be compared between trees and over time to decide when to rebuild.
+    CQuality analyze( const double window = 0.01 );
+
     uint32_t getDim() const;
 
+    Insertion getInsertion() const;
+
+    // the split algorithm can be changed anytime, it affects only the nodes split afterwards
+    void setSplit( const CSplitStrategy::Algorithm split_algorithm );
+
+    CSplitStrategy::Algorithm getSplit() const;
+
+    // the budget of the node cache in bytes, CACHE_SIZE full nodes by default
+    void setCacheBudget( const size_t budget );
+
+    void setCachePolicy( const CBufferPool::Policy policy );
+
+    const CBufferPool & getCache() const;
+
+    // In the write-back mode modified nodes stay dirty in the cache. They are written in the order
+    // of their ids when they fill the cache, after every commit_interval insertions and erasures
+    // (never if it is 0) and by flush. Otherwise every modified node is written immediately.
+    void setWriteBack( const bool write_back, const uint32_t commit_interval = 0 );
+
+    // writes the dirty nodes and the header
+    void flush();
+
+    // nodes read and written by the last operation, see lastOpStats
     unsigned lastOpIO() const;
+
+    // Statistics of the last operation and of all the operations since the tree was opened or
+    // resetStats was called. Queries running concurrently overwrite the last operation.
+    CStats lastOpStats() const;
+
+    CStats totalStats() const;
+
+    void resetStats();
 private:
+    CRTree( const string & pr_name, const uint32_t dim,
+            const uint32_t min_child_nodes, const uint32_t max_child_nodes,
+            const uint32_t cache_size, const uint32_t erased_max,
+            const CStorage::Backend backend, const Insertion insertion,
+            const CSplitStrategy::Algorithm split_algorithm, const PageSize page_size, const Encoding encoding );
+
+    // bytes occupied by an encoded node
+    static uint64_t recordSize( const uint32_t dim, const uint32_t max_child_nodes, const Encoding encoding );
+
+    // the greatest fanout whose nodes fit into one page
+    static uint32_t pageFanout( const uint32_t dim, const PageSize page_size, const Encoding encoding );
 
     shared_ptr<CNode> at( const uint32_t id );
 
+    // the same for readers, the lookup is counted in stats
+    shared_ptr<CNode> at( const uint32_t id, CStats & stats );
+
     bool isLeaf( shared_ptr<CNode> node );
 
-    shared_ptr<CNode> chooseLeaf( shared_ptr<CNode> current, const shared_ptr<CNode> to_insert );
+    // MBRs of the node's children, rebuilt if any node was written since they were built
+    shared_ptr<const CChildBoxes> childBoxes( const shared_ptr<CNode> & node, CStats & stats );
+
+    // levels are counted from the bottom, data nodes are at level 0 and leaves at level 1
+    uint32_t height();
+
+    // inserts the node as a child of some node at the given level
+    void insertNode( const shared_ptr<CNode> & to_insert, const uint32_t level );
+
+    // descends from current (which is at current_level) to the best node at the given level
+    shared_ptr<CNode> chooseLeaf( shared_ptr<CNode> current, const uint32_t current_level,
+                                  const shared_ptr<CNode> to_insert, const uint32_t level );
+
+    // Hilbert R-tree: inserts the node as a child of the node at the given level covering its Hilbert value
+    void insertHilbert( const shared_ptr<CNode> & to_insert, const uint32_t level );
+
+    // the child of current with the smallest LHV not less than key, or with the greatest LHV
+    shared_ptr<CNode> chooseByKey( const shared_ptr<CNode> & current, const uint64_t key );
+
+    // Deferred splitting: the children of the overflowed node and of its cooperating sibling are
+    // spread evenly among them in the order of their Hilbert values, a new node is added to them
+    // only if both are full (2-to-3 split). Returns the new node or nullptr.
+    shared_ptr<CNode> shareOverflow( const shared_ptr<CNode> & parent, const shared_ptr<CNode> & node );
 
-    pair<shared_ptr<CNode>, shared_ptr<CNode>> pickSeeds( list<uint32_t> & child_nodes_id );
+    // replaces the children of the node by the given ones, the moved ones are written
+    void assignChildren( const shared_ptr<CNode> & node, vector<shared_ptr<CNode>>::const_iterator first,
+                         vector<shared_ptr<CNode>>::const_iterator last );
 
-    shared_ptr<CNode> pickNext( list<uint32_t> & child_nodes,
-                                const shared_ptr<CNode> & A,
-                                const shared_ptr<CNode> & B );
+    // Hilbert value of the center of the box, 64 / dim bits per axis of the order preserving
+    // mapping of the coordinates
+    uint64_t hilbertKey( const CHyperrectangle & box ) const;
 
-    // "quadratic split"
+    // R*-tree: the child of current whose overlap with its siblings grows the least by inserting
+    shared_ptr<CNode> chooseByOverlap( const shared_ptr<CNode> & current, const shared_ptr<CNode> & to_insert );
+
+    // R*-tree forced reinsertion: the first overflow at each level during one insertion is treated
+    // by moving the children farthest from the center of the node to orphans, returns false if
+    // the node has to be split instead
+    bool reinsert( const shared_ptr<CNode> & node, const uint32_t level, list<pair<shared_ptr<CNode>, uint32_t>> & orphans );
+
+    // removes underfull nodes on the path from the leaf to the root, shrinks the MBRs
+    // of the others and reinserts the orphaned entries
+    void condenseTree( shared_ptr<CNode> leaf );
+
+    // recomputes the MBR and the LHV of the node from its children
+    void tighten( const shared_ptr<CNode> & node );
+
+    // splits by the split strategy of the tree, the first node keeps the id of to_split
     pair<shared_ptr<CNode>, shared_ptr<CNode>> split( const shared_ptr<CNode> & to_split );
 
-    void adjustTree( const shared_ptr<CNode> current, shared_ptr<CNode> current_split_partner = nullptr );
+    // propagates the change of current (which is at the given level and whose count was count
+    // before the change) up to the root, children removed by forced reinsertion are appended to orphans
+    void adjustTree( shared_ptr<CNode> current, shared_ptr<CNode> split_partner, uint32_t count, uint32_t level,
+                     list<pair<shared_ptr<CNode>, uint32_t>> & orphans );
 
     void writeNode( const shared_ptr<CNode> node );
 
+    // writes the dirty nodes, runs of consecutive ids by single writes
+    void writeDirty();
+
+    // called after every insertion and erasure, writes the dirty nodes if the commit interval elapsed
+    void commit();
+
     shared_ptr<CNode> readNode( const uint32_t id );
 
+    // position of the node in the file
+    uint64_t offset( const uint32_t id ) const;
+
+    // writes NODE_SIZE bytes, the rest of the page is zeroed, see quantizeChildren for nodes
+    void encodeNode( const CNode & node, char * buffer, const vector<shared_ptr<CNode>> * nodes = nullptr ) const;
+
+    shared_ptr<CNode> decodeNode( const char * buffer ) const;
+
+    // Quantizes the MBRs of the children relative to the MBR of the node, two values per axis and child.
+    // The children are taken from nodes (indexed by id - 1) if given, otherwise from the cache.
+    // Returns false if some child is not cached or does not lie within the node.
+    bool quantizeChildren( const CNode & node, vector<uint16_t> & quantized, bool & data,
+                           const vector<shared_ptr<CNode>> * nodes ) const;
+
+    // writes the header, the empty list of erased data objects and the id set, see readUsedIds
     void save();
 
+    // throws if the tree is read-only
+    void checkWritable() const;
+
+    // the map of the used ids, loaded at the first use (before the tree is modified)
+    unordered_map<uint32_t, uint32_t> & usedIds();
+
+    // Reads the id set written by save. Returns false if it is missing (the file was written by an
+    // older version) or does not describe the current nodes (the tree was not saved after a change).
+    bool readUsedIds();
+
+    // refills the map and the free slots by reading the whole tree
     void retrieveUsedIds();
 
-    void rebuild();
+    // id for a new node, a free slot if there is any
+    uint32_t allocate();
+
+    // the node was removed from the tree, its slot is free
+    void release( const uint32_t id );
+
+    // Runs query( i, results[i] ) for every i < count on the thread pool, query returns the number
+    // of nodes it read.
+    vector<list<tuple<uint32_t, vector<double>, vector<double>>>> runBatch( const size_t count,
+                                                                            const function<unsigned( const size_t, list<tuple<uint32_t, vector<double>, vector<double>>> & )> & query,
+                                                                            CBatchStats * stats );
+
+    struct CJoin
+    {
+        CJoin( CRTree & other, const CJoinVisitor & visitor );
+
+        CRTree & other;
+        const CJoinVisitor & visitor;
+        mutex visitor_mutex;
+        atomic<bool> stopped;
+    };
+
+    // Joins the children of the nodes (ids in this and the other tree) overlapping the intersection
+    // of the nodes by a plane sweep, a leaf is joined with the children of a higher node. The pairs
+    // of the inner nodes are appended to pairs, the pairs of the data nodes are passed to the visitor.
+    // Returns false if the join was stopped.
+    bool joinStep( CJoin & join, const pair<uint32_t, uint32_t> & nodes, CStats & stats, vector<pair<uint32_t, uint32_t>> & pairs );
+
+    // the stats become the last operation started at start and are added to the total
+    void record( CStats & stats, const chrono::steady_clock::time_point & start );
+
+    // all data objects in the tree
+    list<tuple<uint32_t, vector<double>, vector<double>>> dataObjects();
+
+    // replaces the whole tree by an STR-packed tree containing data_objects
+    void pack( const list<tuple<uint32_t, vector<double>, vector<double>>> & data_objects );
+
+    // appends groups of at most MAX_CHILD_NODES nodes to be packed into one parent
+    void strTile( vector<shared_ptr<CNode>>::iterator first, vector<shared_ptr<CNode>>::iterator last,
+                  const size_t nodes, const uint32_t axis,
+                  vector<pair<vector<shared_ptr<CNode>>::iterator, vector<shared_ptr<CNode>>::iterator>> & groups );
 
     string pr_name;
-    fstream file;
+    unique_ptr<CStorage> storage;
+    vector<char> node_buffer;
 
     uint32_t HEADER_SIZE;
     uint32_t NODE_SIZE;
 
+    // every tree has its own fanout, so several trees can be open at once
+    uint32_t MIN_CHILD_NODES;
+    uint32_t MAX_CHILD_NODES;
+    // the header takes the first page, the node with id i the page i
+    PageSize page_size;
+    Encoding encoding;
+
     uint32_t dim;
 
     uint32_t root_id;
     uint32_t next_id;
-    unordered_set<uint32_t> data_object_ids_used;
+    // data object id -> id of the data node, see usedIds
+    unordered_map<uint32_t, uint32_t> data_object_ids_used;
+    // slots below next_id not taken by any node, loaded together with the ids
+    set<uint32_t> free_ids;
+    atomic<bool> ids_loaded;
+    mutex ids_mutex;
+    // where the id set of the opened file starts
+    uint64_t ids_offset;
 
     uint32_t CACHE_SIZE;
-    vector<shared_ptr<CNode>> cache;
+    CBufferPool cache;
 
-    unordered_map<uint32_t, uint32_t> parent_nodes;
-
-    unordered_set<uint32_t> erased;
     uint32_t ERASED_MAX;
 
-    unsigned last_op_io;
+    Insertion insertion;
+    unique_ptr<CSplitStrategy> splitter;
+    // levels where the forced reinsertion was already done during the current insertion
+    unordered_set<uint32_t> reinserted_levels;
+
+    // number of the children considered by chooseByOverlap
+    static constexpr uint32_t OVERLAP_CANDIDATES = 32;
+    // percentage of the children moved by the forced reinsertion
+    static constexpr uint32_t REINSERT_PERCENT = 30;
+
+    // the operation in progress of the modifications, which are exclusive
+    CStats op_stats;
+    CStats last_op_stats;
+    CStats total_stats;
+    mutable mutex stats_mutex;
+
+    // shared by the queries, exclusive for the modifications
+    shared_mutex tree_mutex;
+
+    // created by the first batch
+    unique_ptr<CThreadPool> pool;
+    unsigned batch_threads;
+    // The locks are taken in the order pool_mutex, the pool's run, tree_mutex (a join locks
+    // both trees at once), ids_mutex and stats_mutex. The queries of a batch lock the tree
+    // in the tasks, so a join locks the trees while the pool is running.
+    mutex pool_mutex;
+
+    bool write_back;
+    uint32_t commit_interval;
+    // insertions and erasures since the dirty nodes were written
+    uint32_t uncommitted;
+
+    bool read_only;
+
+    // nodes written by one call at most
+    static constexpr uint32_t MAX_WRITE_RUN = 256;
+
+    // marks the start of the id set
+    static constexpr uint32_t ID_SET_MAGIC = 0x54455349;
+
+    // flags of a compact node
+    static constexpr uint8_t CHILD_BOXES = 1;
+    static constexpr uint8_t DATA_CHILDREN = 2;
+
+    friend class CNearestCursor;
 
     friend ostream & operator<<( ostream & os, CRTree & rtree );
 };
 
-bool sortByMinDist( const pair<uint32_t, double> & a, const pair<uint32_t, double> & b );
-
 // debug
 ostream & operator<<( ostream & os, CRTree & rtree );
 
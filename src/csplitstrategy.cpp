@@ -0,0 +1,368 @@
+#include "csplitstrategy.h"
+
+#include <float.h>
+#include <cmath>
+#include <algorithm>
+
+unique_ptr<CSplitStrategy> CSplitStrategy::create( const Algorithm algorithm )
+{
+    switch( algorithm )
+    {
+    case LINEAR:
+        return unique_ptr<CSplitStrategy>( new CLinearSplit() );
+    case QUADRATIC:
+        return unique_ptr<CSplitStrategy>( new CQuadraticSplit() );
+    case RSTAR:
+        return unique_ptr<CSplitStrategy>( new CRStarSplit() );
+    case ANG_TAN:
+        return unique_ptr<CSplitStrategy>( new CAngTanSplit() );
+    default:
+        throw logic_error( "Unknown split algorithm." );
+    }
+}
+
+// Guttman's rule: the group enlarged less, then the smaller one, then the one with fewer boxes.
+// Returns 1 for the second group.
+static int chooseGroup( const CHyperrectangle * groups, const size_t * sizes,
+                        const double enlargement_a, const double enlargement_b )
+{
+    if( enlargement_a != enlargement_b )
+        return enlargement_a < enlargement_b ? 0 : 1;
+
+    double volume_a = groups[0].volume();
+    double volume_b = groups[1].volume();
+    if( volume_a != volume_b )
+        return volume_a < volume_b ? 0 : 1;
+
+    return sizes[0] <= sizes[1] ? 0 : 1;
+}
+
+// Distributes the boxes which are not assigned yet. next picks the box to be assigned next
+// together with its enlargements of both groups.
+template <typename F>
+static void distribute( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size,
+                        const size_t seed_a, const size_t seed_b, vector<bool> & second, F next )
+{
+    vector<bool> assigned( boxes.size(), false );
+    assigned[ seed_a ] = assigned[ seed_b ] = true;
+    second[ seed_b ] = true;
+
+    CHyperrectangle groups[2] = { * boxes[ seed_a ], * boxes[ seed_b ] };
+    size_t sizes[2] = { 1, 1 };
+    size_t picked = 0;
+    double enlargement_a = 0, enlargement_b = 0;
+    int group;
+
+    for( size_t remaining = boxes.size() - 2 ; remaining > 0 ; remaining-- )
+    {
+        // the rest goes to the group which would not get min_size boxes otherwise
+        if( sizes[0] + remaining == min_size || sizes[1] + remaining == min_size )
+        {
+            group = sizes[0] + remaining == min_size ? 0 : 1;
+            for( size_t i = 0 ; i < boxes.size() ; i++ )
+                if( ! assigned[i] )
+                    second[i] = group;
+            return;
+        }
+
+        next( groups, assigned, picked, enlargement_a, enlargement_b );
+
+        group = chooseGroup( groups, sizes, enlargement_a, enlargement_b );
+        groups[ group ].merge( * boxes[ picked ] );
+        sizes[ group ]++;
+        assigned[ picked ] = true;
+        second[ picked ] = group;
+    }
+}
+
+vector<bool> CLinearSplit::split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const
+{
+    const size_t count = boxes.size();
+    const unsigned dim = boxes.front()->start().size();
+
+    // the seeds are the box with the highest low side and the one with the lowest high side
+    // along the axis where they are separated the most relative to the width of the node
+    size_t seed_a = 0, seed_b = 1;
+    double max_separation = - DBL_MAX;
+    double separation;
+    for( unsigned axis = 0 ; axis < dim ; axis++ )
+    {
+        size_t highest_low = 0;
+        double min_low = DBL_MAX, max_high = - DBL_MAX;
+        for( size_t i = 0 ; i < count ; i++ )
+        {
+            if( boxes[i]->start()[axis] > boxes[ highest_low ]->start()[axis] )
+                highest_low = i;
+            min_low = min( min_low, boxes[i]->start()[axis] );
+            max_high = max( max_high, boxes[i]->start()[axis] + boxes[i]->dist()[axis] );
+        }
+
+        size_t lowest_high = highest_low == 0 ? 1 : 0;
+        for( size_t i = 0 ; i < count ; i++ )
+            if( i != highest_low && boxes[i]->start()[axis] + boxes[i]->dist()[axis]
+                                    < boxes[ lowest_high ]->start()[axis] + boxes[ lowest_high ]->dist()[axis] )
+                lowest_high = i;
+
+        separation = boxes[ highest_low ]->start()[axis] - ( boxes[ lowest_high ]->start()[axis] + boxes[ lowest_high ]->dist()[axis] );
+        if( max_high > min_low )
+            separation /= max_high - min_low;
+
+        if( separation > max_separation )
+        {
+            max_separation = separation;
+            seed_a = lowest_high;
+            seed_b = highest_low;
+        }
+    }
+
+    vector<bool> second( count, false );
+    distribute( boxes, min_size, seed_a, seed_b, second, [&]( const CHyperrectangle * groups, const vector<bool> & assigned,
+                                                              size_t & picked, double & enlargement_a, double & enlargement_b )
+    {
+        picked = find( assigned.begin(), assigned.end(), false ) - assigned.begin();
+        enlargement_a = groups[0].enlargementWith( * boxes[ picked ] );
+        enlargement_b = groups[1].enlargementWith( * boxes[ picked ] );
+    } );
+    return second;
+}
+
+CSplitStrategy::Algorithm CLinearSplit::algorithm() const { return LINEAR; }
+
+vector<bool> CQuadraticSplit::split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const
+{
+    const size_t count = boxes.size();
+
+    vector<double> volumes( count );
+    for( size_t i = 0 ; i < count ; i++ )
+        volumes[i] = boxes[i]->volume();
+
+    // the pair wasting the most volume if it was put together
+    size_t seed_a = 0, seed_b = 1;
+    double max_waste = - DBL_MAX;
+    double waste;
+    for( size_t i = 0 ; i < count ; i++ )
+        for( size_t j = i + 1 ; j < count ; j++ )
+        {
+            waste = boxes[i]->mergedVolume( * boxes[j] ) - volumes[i] - volumes[j];
+            if( waste > max_waste )
+            {
+                max_waste = waste;
+                seed_a = i;
+                seed_b = j;
+            }
+        }
+
+    vector<bool> second( count, false );
+    distribute( boxes, min_size, seed_a, seed_b, second, [&]( const CHyperrectangle * groups, const vector<bool> & assigned,
+                                                              size_t & picked, double & enlargement_a, double & enlargement_b )
+    {
+        // the box with the greatest preference for one of the groups
+        double max_diff = -1;
+        double diff, a, b;
+        for( size_t i = 0 ; i < count ; i++ )
+        {
+            if( assigned[i] )
+                continue;
+
+            a = groups[0].enlargementWith( * boxes[i] );
+            b = groups[1].enlargementWith( * boxes[i] );
+            diff = abs( a - b );
+            if( diff > max_diff )
+            {
+                max_diff = diff;
+                picked = i;
+                enlargement_a = a;
+                enlargement_b = b;
+            }
+        }
+    } );
+    return second;
+}
+
+CSplitStrategy::Algorithm CQuadraticSplit::algorithm() const { return QUADRATIC; }
+
+// the R* split keeping the MBRs of the distributions as Box, see CBox
+template <typename Box>
+static vector<bool> rstarSplit( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size )
+{
+    const size_t count = boxes.size();
+    const unsigned dim = boxes.front()->start().size();
+
+    vector<size_t> order( count );
+
+    // the boxes are sorted by their lower or upper coordinates on the axis
+    auto sortBoxes = [&]( const unsigned axis, const bool upper )
+    {
+        for( size_t i = 0 ; i < count ; i++ )
+            order[i] = i;
+        sort( order.begin(), order.end(), [&]( const size_t a, const size_t b )
+        {
+            if( upper )
+                return boxes[a]->start()[axis] + boxes[a]->dist()[axis] < boxes[b]->start()[axis] + boxes[b]->dist()[axis];
+            return boxes[a]->start()[axis] < boxes[b]->start()[axis];
+        } );
+    };
+
+    // prefix[i] is the MBR of the first i + 1 boxes, suffix[i] the MBR of the boxes from i
+    vector<Box> prefix( count ), suffix( count );
+    auto computeBounds = [&]()
+    {
+        prefix[0] = Box( * boxes[ order[0] ] );
+        for( size_t i = 1 ; i < count ; i++ )
+            ( prefix[i] = prefix[i - 1] ).merge( * boxes[ order[i] ] );
+        suffix[count - 1] = Box( * boxes[ order[count - 1] ] );
+        for( size_t i = count - 1 ; i-- > 0 ; )
+            ( suffix[i] = suffix[i + 1] ).merge( * boxes[ order[i] ] );
+    };
+
+    // the axis with the least sum of the margins of all the distributions
+    unsigned split_axis = 0;
+    double min_margin = DBL_MAX;
+    double margin;
+    for( unsigned axis = 0 ; axis < dim ; axis++ )
+    {
+        margin = 0;
+        for( const bool upper : { false, true } )
+        {
+            sortBoxes( axis, upper );
+            computeBounds();
+            for( size_t k = min_size ; k <= count - min_size ; k++ )
+                margin += prefix[k - 1].margin() + suffix[k].margin();
+        }
+
+        if( margin < min_margin )
+        {
+            min_margin = margin;
+            split_axis = axis;
+        }
+    }
+
+    // the distribution with the least overlap, then the least volume
+    bool split_upper = false;
+    size_t split_size = min_size;
+    double min_overlap = DBL_MAX;
+    double min_volume = DBL_MAX;
+    double overlap, volume;
+    for( const bool upper : { false, true } )
+    {
+        sortBoxes( split_axis, upper );
+        computeBounds();
+        for( size_t k = min_size ; k <= count - min_size ; k++ )
+        {
+            overlap = prefix[k - 1].overlapVolume( suffix[k] );
+            volume = prefix[k - 1].volume() + suffix[k].volume();
+            if( overlap < min_overlap || ( overlap == min_overlap && volume < min_volume ) )
+            {
+                min_overlap = overlap;
+                min_volume = volume;
+                split_upper = upper;
+                split_size = k;
+            }
+        }
+    }
+    sortBoxes( split_axis, split_upper );
+
+    vector<bool> second( count, false );
+    for( size_t i = split_size ; i < count ; i++ )
+        second[ order[i] ] = true;
+    return second;
+}
+
+vector<bool> CRStarSplit::split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const
+{
+    return dispatchDimension( boxes.front()->start().size(), [&]( auto geometry )
+    {
+        return rstarSplit<typename CBox<decltype( geometry )::DIM>::type>( boxes, min_size );
+    } );
+}
+
+CSplitStrategy::Algorithm CRStarSplit::algorithm() const { return RSTAR; }
+
+vector<bool> CAngTanSplit::split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const
+{
+    const size_t count = boxes.size();
+    const unsigned dim = boxes.front()->start().size();
+
+    CHyperrectangle node = * boxes.front();
+    for( size_t i = 1 ; i < count ; i++ )
+        node.merge( * boxes[i] );
+
+    // distance of the box from the lower and the upper side of the node
+    auto lowGap = [&]( const size_t i, const unsigned axis ) { return boxes[i]->start()[axis] - node.start()[axis]; };
+    auto highGap = [&]( const size_t i, const unsigned axis )
+    {
+        return node.start()[axis] + node.dist()[axis] - boxes[i]->start()[axis] - boxes[i]->dist()[axis];
+    };
+
+    // the most even distribution, then the least overlap, then the least total volume
+    vector<bool> second( count, false ), current( count );
+    size_t best_larger = count + 1;
+    double best_overlap = DBL_MAX;
+    double best_volume = DBL_MAX;
+    unsigned split_axis = 0;
+
+    for( unsigned axis = 0 ; axis < dim ; axis++ )
+    {
+        size_t upper_count = 0;
+        for( size_t i = 0 ; i < count ; i++ )
+        {
+            current[i] = lowGap( i, axis ) >= highGap( i, axis );
+            upper_count += current[i];
+        }
+
+        const size_t larger = max( upper_count, count - upper_count );
+        if( larger > best_larger )
+            continue;
+
+        double overlap = 0, volume = 0;
+        if( upper_count != 0 && upper_count != count )
+        {
+            CHyperrectangle groups[2];
+            bool empty[2] = { true, true };
+            for( size_t i = 0 ; i < count ; i++ )
+            {
+                if( empty[ current[i] ] )
+                    groups[ current[i] ] = * boxes[i];
+                else
+                    groups[ current[i] ].merge( * boxes[i] );
+                empty[ current[i] ] = false;
+            }
+            overlap = groups[0].overlapVolume( groups[1] );
+            volume = groups[0].volume() + groups[1].volume();
+        }
+
+        if( larger < best_larger || overlap < best_overlap || ( overlap == best_overlap && volume < best_volume ) )
+        {
+            best_larger = larger;
+            best_overlap = overlap;
+            best_volume = volume;
+            split_axis = axis;
+            second = current;
+        }
+    }
+
+    // the boxes of the larger group closest to the other side are moved until both groups are filled
+    size_t upper_count = count_if( second.begin(), second.end(), []( const bool x ) { return x; } );
+    if( upper_count < min_size || count - upper_count < min_size )
+    {
+        const bool to_upper = upper_count < min_size;
+        vector<size_t> candidates;
+        for( size_t i = 0 ; i < count ; i++ )
+            if( second[i] != to_upper )
+                candidates.push_back( i );
+        sort( candidates.begin(), candidates.end(), [&]( const size_t a, const size_t b )
+        {
+            if( to_upper )
+                return highGap( a, split_axis ) < highGap( b, split_axis );
+            return lowGap( a, split_axis ) < lowGap( b, split_axis );
+        } );
+
+        const size_t missing = min_size - ( to_upper ? upper_count : count - upper_count );
+        for( size_t i = 0 ; i < missing ; i++ )
+            second[ candidates[i] ] = to_upper;
+    }
+
+    return second;
+}
+
+CSplitStrategy::Algorithm CAngTanSplit::algorithm() const { return ANG_TAN; }
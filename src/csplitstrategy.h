@@ -0,0 +1,70 @@
+#ifndef CSPLITSTRATEGY_H
+#define CSPLITSTRATEGY_H
+
+#include "chyperrectangle.h"
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+// divides the children of an overflowed node into two groups
+class CSplitStrategy
+{
+public:
+    enum Algorithm { LINEAR, QUADRATIC, RSTAR, ANG_TAN };
+
+    static unique_ptr<CSplitStrategy> create( const Algorithm algorithm );
+
+    virtual ~CSplitStrategy() = default;
+
+    // Returns true for the boxes of the second group. Both groups get at least min_size boxes,
+    // min_size has to be at least 1 and at most boxes.size() / 2.
+    virtual vector<bool> split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const = 0;
+
+    virtual Algorithm algorithm() const = 0;
+};
+
+// Guttman's linear split: the seeds are the boxes farthest apart along some axis,
+// the rest is assigned in any order
+class CLinearSplit : public CSplitStrategy
+{
+public:
+    vector<bool> split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const override;
+
+    Algorithm algorithm() const override;
+};
+
+// Guttman's quadratic split: the seeds waste the most volume together, the boxes with
+// the strongest preference for one of the groups are assigned first
+class CQuadraticSplit : public CSplitStrategy
+{
+public:
+    vector<bool> split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const override;
+
+    Algorithm algorithm() const override;
+};
+
+// R*-split of Beckmann et al.: the axis with the least margin, then the distribution along it
+// with the least overlap
+class CRStarSplit : public CSplitStrategy
+{
+public:
+    vector<bool> split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const override;
+
+    Algorithm algorithm() const override;
+};
+
+// Linear split of Ang and Tan: every box goes to the nearer side of the node along each axis,
+// the axis giving the most even distribution is used
+class CAngTanSplit : public CSplitStrategy
+{
+public:
+    vector<bool> split( const vector<const CHyperrectangle *> & boxes, const uint32_t min_size ) const override;
+
+    Algorithm algorithm() const override;
+};
+
+#endif // CSPLITSTRATEGY_H
@@ -0,0 +1,386 @@
+#include "cstorage.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <filesystem>
+#endif
+
+unique_ptr<CStorage> CStorage::open( const string & path, const Backend backend, const bool create )
+{
+    switch( backend )
+    {
+    case STREAM:
+        return unique_ptr<CStorage>( new CStreamStorage( path, create ) );
+    case MMAP:
+        return unique_ptr<CStorage>( new CMmapStorage( path, create ) );
+    case DIRECT:
+        return unique_ptr<CStorage>( new CDirectStorage( path, create ) );
+    default:
+        throw logic_error( "Unknown storage backend." );
+    }
+}
+
+CStorage::CStorage( const string & path )
+    : path( path )
+{}
+
+const char * CStorage::view( const uint64_t, const size_t ) { return nullptr; }
+
+#ifndef _WIN32
+
+CStreamStorage::CStreamStorage( const string & path, const bool create )
+    : CStorage( path )
+{
+    fd = ::open( path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644 );
+    if( fd < 0 ) throw runtime_error( "\"" + path + "\"" + " cannot be opened." );
+}
+
+CStreamStorage::~CStreamStorage()
+{
+    ::close( fd );
+}
+
+void CStreamStorage::read( const uint64_t offset, char * buffer, const size_t size )
+{
+    size_t done = 0;
+    ssize_t count;
+    while( done < size )
+    {
+        count = pread( fd, buffer + done, size - done, offset + done );
+        if( count < 0 ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+        // reading past the end of the file is not an error, the rest of the buffer is zeroed
+        if( count == 0 )
+        {
+            memset( buffer + done, 0, size - done );
+            return;
+        }
+        done += count;
+    }
+}
+
+void CStreamStorage::write( const uint64_t offset, const char * buffer, const size_t size )
+{
+    size_t done = 0;
+    ssize_t count;
+    while( done < size )
+    {
+        count = pwrite( fd, buffer + done, size - done, offset + done );
+        if( count <= 0 ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+        done += count;
+    }
+}
+
+void CStreamStorage::flush()
+{
+    if( fsync( fd ) ) throw runtime_error( "\"" + path + "\"" + " could not be saved correctly." );
+}
+
+void CStreamStorage::truncate( const uint64_t size )
+{
+    if( ftruncate( fd, size ) ) throw runtime_error( "\"" + path + "\"" + " cannot be truncated." );
+}
+
+#else
+
+CStreamStorage::CStreamStorage( const string & path, const bool create )
+    : CStorage( path )
+{
+    if( create )
+        file.open( path, ios::in | ios::out | ios::binary | ios::trunc );
+    else
+        file.open( path, ios::in | ios::out | ios::binary );
+
+    if( ! file.is_open() ) throw runtime_error( "\"" + path + "\"" + " cannot be opened." );
+}
+
+CStreamStorage::~CStreamStorage()
+{
+    file.close();
+}
+
+void CStreamStorage::read( const uint64_t offset, char * buffer, const size_t size )
+{
+    lock_guard<mutex> lock( file_mutex );
+
+    file.seekg( offset );
+    file.read( buffer, size );
+
+    if( file.bad() ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+
+    // reading past the end of the file is not an error, the rest of the buffer is zeroed
+    if( file.fail() )
+    {
+        memset( buffer + file.gcount(), 0, size - file.gcount() );
+        file.clear();
+    }
+}
+
+void CStreamStorage::write( const uint64_t offset, const char * buffer, const size_t size )
+{
+    lock_guard<mutex> lock( file_mutex );
+
+    file.seekp( offset );
+    file.write( buffer, size );
+
+    if( file.bad() ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+}
+
+void CStreamStorage::flush()
+{
+    lock_guard<mutex> lock( file_mutex );
+
+    file.flush();
+
+    if( file.bad() ) throw runtime_error( "\"" + path + "\"" + " could not be saved correctly." );
+}
+
+void CStreamStorage::truncate( const uint64_t size )
+{
+    lock_guard<mutex> lock( file_mutex );
+
+    file.flush();
+    // the file keeps its length if it cannot be truncated while open
+    error_code error;
+    filesystem::resize_file( path, size, error );
+}
+
+#endif
+
+CStorage::Backend CStreamStorage::backend() const { return STREAM; }
+
+#ifndef _WIN32
+
+CMmapStorage::CMmapStorage( const string & path, const bool create )
+    : CStorage( path ), mapping( nullptr ), capacity( 0 ), size_( 0 )
+{
+    fd = ::open( path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644 );
+    if( fd < 0 ) throw runtime_error( "\"" + path + "\"" + " cannot be opened." );
+
+    struct stat st;
+    if( fstat( fd, & st ) )
+    {
+        ::close( fd );
+        throw runtime_error( "\"" + path + "\"" + " cannot be opened." );
+    }
+    size_ = st.st_size;
+
+    reserve( size_ );
+}
+
+CMmapStorage::~CMmapStorage()
+{
+    if( mapping )
+    {
+        msync( mapping, capacity, MS_SYNC );
+        munmap( mapping, capacity );
+    }
+    // the file keeps its chunk aligned length if it cannot be truncated
+    if( ftruncate( fd, size_ ) ) {}
+    ::close( fd );
+}
+
+void CMmapStorage::read( const uint64_t offset, char * buffer, const size_t size )
+{
+    if( offset >= size_ )
+    {
+        memset( buffer, 0, size );
+        return;
+    }
+
+    size_t available = min<uint64_t>( size, size_ - offset );
+    memcpy( buffer, mapping + offset, available );
+    memset( buffer + available, 0, size - available );
+}
+
+void CMmapStorage::write( const uint64_t offset, const char * buffer, const size_t size )
+{
+    reserve( offset + size );
+    memcpy( mapping + offset, buffer, size );
+    size_ = max( size_, offset + size );
+}
+
+const char * CMmapStorage::view( const uint64_t offset, const size_t size )
+{
+    if( offset + size > size_ ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+    return mapping + offset;
+}
+
+void CMmapStorage::flush()
+{
+    if( mapping && msync( mapping, capacity, MS_SYNC ) )
+        throw runtime_error( "\"" + path + "\"" + " could not be saved correctly." );
+}
+
+void CMmapStorage::truncate( const uint64_t size )
+{
+    // the mapping is kept, the file is truncated when closed
+    size_ = min( size_, size );
+}
+
+CStorage::Backend CMmapStorage::backend() const { return MMAP; }
+
+void CMmapStorage::reserve( const uint64_t size )
+{
+    if( size <= capacity && mapping )
+        return;
+
+    // the file grows by chunks proportional to its size
+    uint64_t chunk = min( MAX_CHUNK_SIZE, max( MIN_CHUNK_SIZE, capacity ) );
+    uint64_t new_capacity = max<uint64_t>( ( size + chunk - 1 ) / chunk * chunk, chunk );
+
+    if( mapping )
+        munmap( mapping, capacity );
+    mapping = nullptr;
+
+    if( ftruncate( fd, new_capacity ) ) throw runtime_error( "\"" + path + "\"" + " cannot be extended." );
+
+    void * addr = mmap( nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( addr == MAP_FAILED ) throw runtime_error( "\"" + path + "\"" + " cannot be mapped." );
+
+    mapping = ( char * ) addr;
+    capacity = new_capacity;
+}
+
+#else
+
+CMmapStorage::CMmapStorage( const string & path, const bool )
+    : CStorage( path ), fd( -1 ), mapping( nullptr ), capacity( 0 ), size_( 0 )
+{
+    throw logic_error( "Memory mapped files are not supported on this platform." );
+}
+
+CMmapStorage::~CMmapStorage() {}
+
+void CMmapStorage::read( const uint64_t, char *, const size_t ) {}
+
+void CMmapStorage::write( const uint64_t, const char *, const size_t ) {}
+
+const char * CMmapStorage::view( const uint64_t, const size_t ) { return nullptr; }
+
+void CMmapStorage::flush() {}
+
+void CMmapStorage::truncate( const uint64_t ) {}
+
+CStorage::Backend CMmapStorage::backend() const { return MMAP; }
+
+void CMmapStorage::reserve( const uint64_t ) {}
+
+#endif
+
+#if ! defined( _WIN32 ) && defined( O_DIRECT )
+
+// aligned buffer of whole blocks
+struct CBlockBuffer
+{
+    CBlockBuffer( const size_t size )
+    {
+        if( posix_memalign( ( void ** ) & data, CDirectStorage::BLOCK_SIZE, size ) ) throw bad_alloc();
+    }
+
+    ~CBlockBuffer() { free( data ); }
+
+    char * data;
+};
+
+CDirectStorage::CDirectStorage( const string & path, const bool create )
+    : CStorage( path )
+{
+    fd = ::open( path.c_str(), ( create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR ) | O_DIRECT, 0644 );
+    if( fd < 0 ) throw runtime_error( "\"" + path + "\"" + " cannot be opened." );
+}
+
+CDirectStorage::~CDirectStorage()
+{
+    ::close( fd );
+}
+
+void CDirectStorage::read( const uint64_t offset, char * buffer, const size_t size )
+{
+    const uint64_t first = offset / BLOCK_SIZE * BLOCK_SIZE;
+    const uint64_t last = ( offset + size + BLOCK_SIZE - 1 ) / BLOCK_SIZE * BLOCK_SIZE;
+
+    CBlockBuffer blocks( last - first );
+    readBlocks( first, blocks.data, last - first );
+    memcpy( buffer, blocks.data + ( offset - first ), size );
+}
+
+void CDirectStorage::write( const uint64_t offset, const char * buffer, const size_t size )
+{
+    const uint64_t first = offset / BLOCK_SIZE * BLOCK_SIZE;
+    const uint64_t last = ( offset + size + BLOCK_SIZE - 1 ) / BLOCK_SIZE * BLOCK_SIZE;
+
+    CBlockBuffer blocks( last - first );
+    if( first != offset || last != offset + size )
+        readBlocks( first, blocks.data, last - first );
+    memcpy( blocks.data + ( offset - first ), buffer, size );
+
+    size_t done = 0;
+    ssize_t count;
+    while( done < last - first )
+    {
+        count = pwrite( fd, blocks.data + done, last - first - done, first + done );
+        if( count <= 0 ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+        done += count;
+    }
+}
+
+void CDirectStorage::flush()
+{
+    // the data is not cached, but the metadata of the file may be
+    if( fsync( fd ) ) throw runtime_error( "\"" + path + "\"" + " could not be saved correctly." );
+}
+
+void CDirectStorage::truncate( const uint64_t size )
+{
+    if( ftruncate( fd, size ) ) throw runtime_error( "\"" + path + "\"" + " cannot be truncated." );
+}
+
+void CDirectStorage::readBlocks( const uint64_t offset, char * buffer, const size_t size )
+{
+    size_t done = 0;
+    ssize_t count;
+    while( done < size )
+    {
+        count = pread( fd, buffer + done, size - done, offset + done );
+        if( count < 0 ) throw runtime_error( "\"" + path + "\"" + " is corrupted" );
+        // a short read ends at the end of the file
+        if( count == 0 || ( size_t ) count % BLOCK_SIZE )
+        {
+            memset( buffer + done + count, 0, size - done - count );
+            return;
+        }
+        done += count;
+    }
+}
+
+#else
+
+CDirectStorage::CDirectStorage( const string & path, const bool )
+    : CStorage( path ), fd( -1 )
+{
+    throw logic_error( "Direct I/O is not supported on this platform." );
+}
+
+CDirectStorage::~CDirectStorage() {}
+
+void CDirectStorage::read( const uint64_t, char *, const size_t ) {}
+
+void CDirectStorage::write( const uint64_t, const char *, const size_t ) {}
+
+void CDirectStorage::flush() {}
+
+void CDirectStorage::truncate( const uint64_t ) {}
+
+void CDirectStorage::readBlocks( const uint64_t, char *, const size_t ) {}
+
+#endif
+
+CStorage::Backend CDirectStorage::backend() const { return DIRECT; }
@@ -0,0 +1,141 @@
+#ifndef CSTORAGE_H
+#define CSTORAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <mutex>
+
+using namespace std;
+
+// Byte addressed file the nodes are stored in. Reads and views can be done concurrently,
+// but not together with writes.
+class CStorage
+{
+public:
+    // DIRECT bypasses the page cache of the system, it suits the paged node format
+    enum Backend { STREAM, MMAP, DIRECT };
+
+    // creates a new file (which must not exist) or opens an existing one
+    static unique_ptr<CStorage> open( const string & path, const Backend backend, const bool create );
+
+    virtual ~CStorage() = default;
+
+    virtual void read( const uint64_t offset, char * buffer, const size_t size ) = 0;
+
+    virtual void write( const uint64_t offset, const char * buffer, const size_t size ) = 0;
+
+    // Returns a pointer to the size bytes at offset, which stays valid until the next write,
+    // or nullptr if the backend has to copy the bytes by read.
+    virtual const char * view( const uint64_t offset, const size_t size );
+
+    virtual void flush() = 0;
+
+    // the file ends at size, which is not past its end
+    virtual void truncate( const uint64_t size ) = 0;
+
+    virtual Backend backend() const = 0;
+
+protected:
+    CStorage( const string & path );
+
+    string path;
+};
+
+// positional reads and writes of the file, a stream guarded by a lock where they are not available
+class CStreamStorage : public CStorage
+{
+public:
+    CStreamStorage( const string & path, const bool create );
+
+    ~CStreamStorage() override;
+
+    void read( const uint64_t offset, char * buffer, const size_t size ) override;
+
+    void write( const uint64_t offset, const char * buffer, const size_t size ) override;
+
+    void flush() override;
+
+    void truncate( const uint64_t size ) override;
+
+    Backend backend() const override;
+
+private:
+#ifndef _WIN32
+    int fd;
+#else
+    fstream file;
+    mutex file_mutex;
+#endif
+};
+
+// The file is mapped into memory as a whole and grown in chunks, so nodes are decoded
+// directly from the mapped pages without any system call.
+class CMmapStorage : public CStorage
+{
+public:
+    CMmapStorage( const string & path, const bool create );
+
+    ~CMmapStorage() override;
+
+    void read( const uint64_t offset, char * buffer, const size_t size ) override;
+
+    void write( const uint64_t offset, const char * buffer, const size_t size ) override;
+
+    const char * view( const uint64_t offset, const size_t size ) override;
+
+    void flush() override;
+
+    void truncate( const uint64_t size ) override;
+
+    Backend backend() const override;
+
+    static constexpr uint64_t MIN_CHUNK_SIZE = 1 << 20;
+    static constexpr uint64_t MAX_CHUNK_SIZE = 1 << 26;
+
+private:
+    // maps at least size bytes of the file
+    void reserve( const uint64_t size );
+
+    int fd;
+    char * mapping;
+    // bytes mapped, the file is extended to this length
+    uint64_t capacity;
+    // bytes written, the file is truncated to this length when closed
+    uint64_t size_;
+};
+
+// Positional reads and writes bypassing the page cache of the system (O_DIRECT). The file
+// is accessed by whole aligned blocks through an aligned buffer, parts of a block are written
+// by reading the block first.
+class CDirectStorage : public CStorage
+{
+public:
+    CDirectStorage( const string & path, const bool create );
+
+    ~CDirectStorage() override;
+
+    void read( const uint64_t offset, char * buffer, const size_t size ) override;
+
+    void write( const uint64_t offset, const char * buffer, const size_t size ) override;
+
+    void flush() override;
+
+    void truncate( const uint64_t size ) override;
+
+    Backend backend() const override;
+
+    // alignment of the offsets, sizes and buffers
+    static constexpr uint64_t BLOCK_SIZE = 4096;
+
+private:
+    // reads the aligned blocks, the part past the end of the file is zeroed
+    void readBlocks( const uint64_t offset, char * buffer, const size_t size );
+
+    int fd;
+};
+
+#endif // CSTORAGE_H
@@ -0,0 +1,140 @@
+#include "cthreadpool.h"
+
+CThreadPool::CThreadPool( const unsigned threads )
+    : generation( 0 ), stop( false ), current( nullptr ), remaining( 0 )
+{
+    const unsigned count = threads ? threads : 1;
+
+    for( unsigned i = 0 ; i < count ; i++ )
+        queues.emplace_back( new CQueue() );
+
+    for( unsigned i = 0 ; i + 1 < count ; i++ )
+        workers.emplace_back( & CThreadPool::work, this, i );
+}
+
+CThreadPool::~CThreadPool()
+{
+    {
+        lock_guard<mutex> lock( state_mutex );
+        stop = true;
+    }
+    wake.notify_all();
+
+    for( auto & worker : workers )
+        worker.join();
+}
+
+void CThreadPool::run( const size_t count, const function<void( const size_t )> & task )
+{
+    if( count == 0 )
+        return;
+
+    run( [count]() { return count; }, task );
+}
+
+void CThreadPool::run( const function<size_t()> & prepare, const function<void( const size_t )> & task )
+{
+    lock_guard<mutex> run_lock( run_mutex );
+
+    const size_t count = prepare();
+    if( count == 0 )
+        return;
+
+    current = & task;
+    error = nullptr;
+    remaining = count;
+
+    // every queue gets a contiguous block, neighbouring tasks tend to touch the same nodes
+    const size_t block = ( count + queues.size() - 1 ) / queues.size();
+    for( size_t i = 0 ; i < queues.size() ; i++ )
+    {
+        lock_guard<mutex> lock( queues[i]->queue_mutex );
+        for( size_t j = i * block ; j < min( count, ( i + 1 ) * block ) ; j++ )
+            queues[i]->tasks.push_back( j );
+    }
+
+    {
+        lock_guard<mutex> lock( state_mutex );
+        generation++;
+    }
+    wake.notify_all();
+
+    drain( queues.size() - 1 );
+
+    unique_lock<mutex> lock( state_mutex );
+    done.wait( lock, [this]() { return remaining == 0; } );
+
+    if( error )
+        rethrow_exception( error );
+}
+
+unsigned CThreadPool::size() const { return queues.size(); }
+
+void CThreadPool::work( const unsigned index )
+{
+    uint64_t seen = 0;
+    unique_lock<mutex> lock( state_mutex );
+
+    while( true )
+    {
+        wake.wait( lock, [&]() { return stop || generation != seen; } );
+        if( stop )
+            return;
+        seen = generation;
+
+        lock.unlock();
+        drain( index );
+        lock.lock();
+    }
+}
+
+void CThreadPool::drain( const unsigned index )
+{
+    size_t task;
+    while( pop( index, task ) )
+    {
+        try
+        {
+            ( * current )( task );
+        }
+        catch( ... )
+        {
+            lock_guard<mutex> lock( state_mutex );
+            if( ! error )
+                error = current_exception();
+        }
+
+        if( --remaining == 0 )
+        {
+            lock_guard<mutex> lock( state_mutex );
+            done.notify_all();
+        }
+    }
+}
+
+bool CThreadPool::pop( const unsigned index, size_t & task )
+{
+    {
+        lock_guard<mutex> lock( queues[ index ]->queue_mutex );
+        if( ! queues[ index ]->tasks.empty() )
+        {
+            task = queues[ index ]->tasks.front();
+            queues[ index ]->tasks.pop_front();
+            return true;
+        }
+    }
+
+    for( size_t i = 1 ; i < queues.size() ; i++ )
+    {
+        CQueue & victim = * queues[ ( index + i ) % queues.size() ];
+        lock_guard<mutex> lock( victim.queue_mutex );
+        if( ! victim.tasks.empty() )
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,68 @@
+#ifndef CTHREADPOOL_H
+#define CTHREADPOOL_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+using namespace std;
+
+// Runs loops in parallel. Every worker takes the tasks from the front of its own queue and
+// steals from the back of the others when it runs out of them.
+class CThreadPool
+{
+public:
+    // threads includes the thread calling run, at least one is used
+    CThreadPool( const unsigned threads );
+
+    ~CThreadPool();
+
+    // Calls task( i ) for every i < count and waits until all the calls return. The first
+    // exception thrown by the task is rethrown. Calls of run from several threads are serialized.
+    void run( const size_t count, const function<void( const size_t )> & task );
+
+    // The same, the count is returned by prepare called once the other runs are finished,
+    // so the locks taken by prepare are ordered after the pool.
+    void run( const function<size_t()> & prepare, const function<void( const size_t )> & task );
+
+    unsigned size() const;
+
+private:
+    struct CQueue
+    {
+        mutex queue_mutex;
+        deque<size_t> tasks;
+    };
+
+    void work( const unsigned index );
+
+    // runs the tasks until all the queues are empty
+    void drain( const unsigned index );
+
+    // the task from the front of the own queue or the back of another one
+    bool pop( const unsigned index, size_t & task );
+
+    vector<thread> workers;
+    // the queue of the calling thread is the last one
+    vector<unique_ptr<CQueue>> queues;
+
+    mutex run_mutex;
+    mutex state_mutex;
+    condition_variable wake;
+    condition_variable done;
+    uint64_t generation;
+    bool stop;
+
+    const function<void( const size_t )> * current;
+    atomic<size_t> remaining;
+    exception_ptr error;
+};
+
+#endif // CTHREADPOOL_H
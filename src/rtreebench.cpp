@@ -0,0 +1,580 @@
+// Headless benchmark of CRTree compared with the sequential scan of CNotRTree. The workload is
+// given by --key=value arguments and flags (see usage), the results are printed to stdout as JSON.
+
+#include "crtree.h"
+#include "cnotrtree.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+
+using namespace std;
+
+struct CConfig
+{
+    // uniform, clustered or colinear
+    string data = "uniform";
+    uint32_t n = 100000;
+    uint32_t dim = 2;
+    uint32_t min_child_nodes = 20;
+    uint32_t max_child_nodes = 50;
+    // nodes
+    uint32_t cache_size = 4096;
+    // 0 for the packed format, otherwise 4096, 8192 or 16384 (the fanout is derived from it)
+    uint32_t page_size = 0;
+    // insert or bulk
+    string load = "insert";
+    string insertion = "guttman";
+    string split = "quadratic";
+    string encoding = "plain";
+    string backend = "stream";
+    uint32_t queries = 1000;
+    uint32_t k = 10;
+    // side of the query windows and of the largest data objects relative to the side of the data space
+    double window = 0.05;
+    double size = 0.001;
+    uint32_t clusters = 16;
+    uint32_t seed = 1;
+    // queries repeated on CNotRTree, 0 disables the comparison
+    uint32_t baseline_queries = 20;
+    // exit with 1 if the results of the R-tree and of the baseline differ
+    bool verify = false;
+    // the tree, the baseline uses the same path with .scan appended, both are removed at exit
+    string file = "rtreebench.rt";
+    // replace the files if they exist
+    bool overwrite = false;
+    // an existing tree to analyze instead of the benchmark
+    string analyze;
+};
+
+// measurements of one kind of operations
+struct CPhase
+{
+    string name;
+    // wall time of every operation
+    vector<double> seconds;
+    uint64_t io = 0;
+    uint64_t results = 0;
+    // -1 if not available
+    int64_t hits = -1;
+    int64_t misses = -1;
+    // number of queries returning other data objects than the R-tree, -1 if not compared
+    int64_t mismatches = -1;
+    // the statistics of the tree, the baseline has none
+    bool detailed = false;
+    CStats stats;
+};
+
+typedef tuple<uint32_t, vector<double>, vector<double>> TDataObject;
+
+static void usage()
+{
+    cerr << "usage: rtreebench [--key=value ...]\n"
+            "  --data=uniform|clustered|colinear  --n=N  --dim=D  --min=M  --max=M  --cache=NODES\n"
+            "  --page=0|4096|8192|16384  --load=insert|bulk  --insertion=guttman|rstar|hilbert\n"
+            "  --split=linear|quadratic|rstar|angtan  --encoding=plain|compact  --backend=stream|mmap|direct\n"
+            "  --queries=Q  --k=K  --window=FRACTION  --size=FRACTION  --clusters=C  --seed=S\n"
+            "  --baseline=QUERIES  --verify  --file=PATH  --overwrite\n"
+            "       rtreebench --analyze=PATH [--window=FRACTION]  (the quality of an existing tree)\n";
+}
+
+template <typename T>
+static T parse( const string & key, const string & value )
+{
+    istringstream is( value );
+    T retval;
+    if( ! ( is >> retval ) || ! is.eof() )
+        throw logic_error( "Invalid value of --" + key + ": " + value );
+    return retval;
+}
+
+static string oneOf( const string & key, const string & value, const vector<string> & choices )
+{
+    if( find( choices.begin(), choices.end(), value ) == choices.end() )
+        throw logic_error( "Invalid value of --" + key + ": " + value );
+    return value;
+}
+
+static CConfig parseArguments( const int argc, char ** argv )
+{
+    CConfig config;
+    string argument, key, value;
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        argument = argv[i];
+        if( argument == "--overwrite" || argument == "--verify" )
+        {
+            ( argument == "--overwrite" ? config.overwrite : config.verify ) = true;
+            continue;
+        }
+
+        const size_t equals = argument.find( '=' );
+        if( argument.compare( 0, 2, "--" ) || equals == string::npos )
+            throw logic_error( "Invalid argument: " + argument );
+        key = argument.substr( 2, equals - 2 );
+        value = argument.substr( equals + 1 );
+
+        if( key == "data" ) config.data = oneOf( key, value, { "uniform", "clustered", "colinear" } );
+        else if( key == "n" ) config.n = parse<uint32_t>( key, value );
+        else if( key == "dim" ) config.dim = parse<uint32_t>( key, value );
+        else if( key == "min" ) config.min_child_nodes = parse<uint32_t>( key, value );
+        else if( key == "max" ) config.max_child_nodes = parse<uint32_t>( key, value );
+        else if( key == "cache" ) config.cache_size = parse<uint32_t>( key, value );
+        else if( key == "page" ) config.page_size = parse<uint32_t>( key, value );
+        else if( key == "load" ) config.load = oneOf( key, value, { "insert", "bulk" } );
+        else if( key == "insertion" ) config.insertion = oneOf( key, value, { "guttman", "rstar", "hilbert" } );
+        else if( key == "split" ) config.split = oneOf( key, value, { "linear", "quadratic", "rstar", "angtan" } );
+        else if( key == "encoding" ) config.encoding = oneOf( key, value, { "plain", "compact" } );
+        else if( key == "backend" ) config.backend = oneOf( key, value, { "stream", "mmap", "direct" } );
+        else if( key == "queries" ) config.queries = parse<uint32_t>( key, value );
+        else if( key == "k" ) config.k = parse<uint32_t>( key, value );
+        else if( key == "window" ) config.window = parse<double>( key, value );
+        else if( key == "size" ) config.size = parse<double>( key, value );
+        else if( key == "clusters" ) config.clusters = parse<uint32_t>( key, value );
+        else if( key == "seed" ) config.seed = parse<uint32_t>( key, value );
+        else if( key == "baseline" ) config.baseline_queries = parse<uint32_t>( key, value );
+        else if( key == "file" ) config.file = value;
+        else if( key == "analyze" ) config.analyze = value;
+        else
+            throw logic_error( "Unknown argument: " + argument );
+    }
+
+    if( config.n == 0 || config.dim == 0 )
+        throw logic_error( "--n and --dim have to be positive." );
+    if( config.k > config.n )
+        throw logic_error( "--k cannot exceed --n." );
+    if( config.window < 0 || config.size < 0 || config.clusters == 0 )
+        throw logic_error( "--window and --size cannot be negative, --clusters has to be positive." );
+    if( config.verify && ( config.baseline_queries == 0 || config.queries == 0 ) )
+        throw logic_error( "--verify needs --baseline and --queries to be positive." );
+    return config;
+}
+
+// The data objects with ids from 1 (0 is reserved by CRTree). Uniform objects are spread over
+// [ -1000, 1000 )^dim, clustered ones are normally distributed around random centers and colinear
+// ones are the points ( x, x, ..., x ) for x in [ 0, n ) in ascending order, as in rTreeTestA.
+static vector<TDataObject> generate( const CConfig & config, mt19937 & gen )
+{
+    vector<TDataObject> retval;
+    retval.reserve( config.n );
+
+    uniform_real_distribution<> coordinate( -1000, 1000 );
+    uniform_real_distribution<> side( 0, 2000 * config.size );
+    normal_distribution<> spread( 0, 2000 * 0.02 );
+
+    vector<vector<double>> centers( config.clusters );
+    for( auto & center : centers )
+        for( uint32_t i = 0 ; i < config.dim ; i++ )
+            center.push_back( coordinate( gen ) );
+    uniform_int_distribution<uint32_t> cluster( 0, config.clusters - 1 );
+
+    vector<double> start( config.dim ), dist( config.dim );
+    for( uint32_t id = 1 ; id <= config.n ; id++ )
+    {
+        if( config.data == "colinear" )
+        {
+            retval.push_back( make_tuple( id, vector<double>( config.dim, id - 1 ), vector<double>( config.dim, 0 ) ) );
+            continue;
+        }
+
+        const vector<double> & center = centers[ cluster( gen ) ];
+        for( uint32_t i = 0 ; i < config.dim ; i++ )
+        {
+            start[i] = config.data == "clustered" ? center[i] + spread( gen ) : coordinate( gen );
+            dist[i] = side( gen );
+        }
+        retval.push_back( make_tuple( id, start, dist ) );
+    }
+
+    return retval;
+}
+
+// The k nearest neighbours of the point are the same if the k-th distances are equal and so are the
+// data objects closer than that, the ones at the k-th distance are interchangeable. The data object
+// with id i is data_objects[ i - 1 ].
+static bool sameNeighbours( const vector<uint32_t> & a, const vector<uint32_t> & b,
+                            const vector<TDataObject> & data_objects, const vector<double> & point )
+{
+    if( a.size() != b.size() )
+        return false;
+
+    vector<pair<double, uint32_t>> x, y;
+    for( const uint32_t id : a )
+        x.push_back( make_pair( CHyperrectangle( get<1>( data_objects[ id - 1 ] ), get<2>( data_objects[ id - 1 ] ) ).mindist( point ), id ) );
+    for( const uint32_t id : b )
+        y.push_back( make_pair( CHyperrectangle( get<1>( data_objects[ id - 1 ] ), get<2>( data_objects[ id - 1 ] ) ).mindist( point ), id ) );
+    sort( x.begin(), x.end() );
+    sort( y.begin(), y.end() );
+    if( x.empty() )
+        return true;
+    if( x.back().first != y.back().first )
+        return false;
+
+    const double kth = x.back().first;
+    x.erase( lower_bound( x.begin(), x.end(), make_pair( kth, ( uint32_t ) 0 ) ), x.end() );
+    y.erase( lower_bound( y.begin(), y.end(), make_pair( kth, ( uint32_t ) 0 ) ), y.end() );
+    return x == y;
+}
+
+static double elapsed( const chrono::steady_clock::time_point & start )
+{
+    return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+static double percentile( const vector<double> & sorted, const double p )
+{
+    if( sorted.empty() )
+        return 0;
+    const size_t rank = ( size_t ) ceil( p * sorted.size() );
+    return sorted[ min( sorted.size() - 1, rank ? rank - 1 : 0 ) ];
+}
+
+static void printPhase( ostream & os, const CPhase & phase, const bool last )
+{
+    vector<double> sorted = phase.seconds;
+    sort( sorted.begin(), sorted.end() );
+    double total = 0;
+    for( const double x : sorted )
+        total += x;
+    const size_t operations = sorted.size();
+
+    os << "      \"" << phase.name << "\": {\n";
+    os << "        \"operations\": " << operations << ",\n";
+    os << "        \"seconds\": " << total << ",\n";
+    os << "        \"throughput\": " << ( total > 0 ? operations / total : 0 ) << ",\n";
+    os << "        \"latency_us\": { \"p50\": " << percentile( sorted, 0.5 ) * 1e6
+       << ", \"p99\": " << percentile( sorted, 0.99 ) * 1e6
+       << ", \"p999\": " << percentile( sorted, 0.999 ) * 1e6
+       << ", \"max\": " << ( operations ? sorted.back() * 1e6 : 0 ) << " },\n";
+    os << "        \"io_per_operation\": " << ( operations ? ( double ) phase.io / operations : 0 ) << ",\n";
+    os << "        \"results_per_operation\": " << ( operations ? ( double ) phase.results / operations : 0 );
+    if( phase.hits >= 0 )
+        os << ",\n        \"cache_hit_rate\": " << ( phase.hits + phase.misses ? ( double ) phase.hits / ( phase.hits + phase.misses ) : 0 );
+    if( phase.mismatches >= 0 )
+        os << ",\n        \"result_mismatches\": " << phase.mismatches;
+    if( phase.detailed && operations )
+    {
+        os << ",\n        \"bytes_read_per_operation\": " << ( double ) phase.stats.bytes_read / operations;
+        os << ",\n        \"bytes_written_per_operation\": " << ( double ) phase.stats.bytes_written / operations;
+        os << ",\n        \"splits_per_operation\": " << ( double ) phase.stats.splits / operations;
+        os << ",\n        \"compared_per_operation\": " << ( double ) phase.stats.compared / operations;
+        // only the queries count the visited nodes
+        if( ! phase.stats.visited.empty() )
+        {
+            os << ",\n        \"visited_per_operation_by_depth\": [";
+            for( size_t depth = 0 ; depth < phase.stats.visited.size() ; depth++ )
+                os << ( depth ? ", " : " " ) << ( double ) phase.stats.visited[ depth ] / operations;
+            os << " ]";
+        }
+    }
+    os << "\n      }" << ( last ? "\n" : ",\n" );
+}
+
+static void printQuality( ostream & os, const CQuality & quality, const string & indent )
+{
+    os << indent << "\"quality\": {\n";
+    os << indent << "  \"height\": " << quality.height << ", \"nodes\": " << quality.nodes
+       << ", \"accesses_per_window_query\": " << quality.accesses << ",\n";
+    os << indent << "  \"levels\": [\n";
+    for( size_t level = 0 ; level < quality.levels.size() ; level++ )
+    {
+        const CLevelQuality & x = quality.levels[ level ];
+        os << indent << "    { \"level\": " << level << ", \"nodes\": " << x.nodes
+           << ", \"min_fill\": " << x.min_fill << ", \"avg_fill\": " << x.avg_fill
+           << ", \"area\": " << x.area << ", \"overlap\": " << x.overlap << ", \"dead_space\": " << x.dead_space
+           << ", \"margin\": " << x.margin << ", \"accesses\": " << x.accesses << " }"
+           << ( level + 1 == quality.levels.size() ? "\n" : ",\n" );
+    }
+    os << indent << "  ]\n";
+    os << indent << "}";
+}
+
+// the statistics of the tree are reset before the phase
+static void collect( const CRTree & tree, CPhase & phase )
+{
+    phase.detailed = true;
+    phase.stats = tree.totalStats();
+    phase.io = phase.stats.reads + phase.stats.writes;
+    phase.hits = phase.stats.cache_hits;
+    phase.misses = phase.stats.cache_misses;
+}
+
+int main( int argc, char ** argv )
+{
+    if( argc == 2 && string( argv[1] ) == "--help" )
+    {
+        usage();
+        return 0;
+    }
+
+    CConfig config;
+    try
+    {
+        config = parseArguments( argc, argv );
+    }
+    catch( const exception & e )
+    {
+        cerr << e.what() << endl;
+        usage();
+        return 2;
+    }
+
+    if( ! config.analyze.empty() )
+    {
+        try
+        {
+            // the analysis must not change the file
+            CRTree tree( config.analyze, CStorage::STREAM, true );
+            cout << setprecision( 10 ) << "{\n";
+            cout << "  \"file\": \"" << config.analyze << "\", \"window\": " << config.window << ",\n";
+            printQuality( cout, tree.analyze( config.window ), "  " );
+            cout << "\n}" << endl;
+        }
+        catch( const exception & e )
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // the files are removed at exit, so they are not taken over unless asked to
+    if( ! config.overwrite )
+        for( const string & path : { config.file, config.file + ".scan" } )
+            if( filesystem::exists( path ) )
+            {
+                cerr << "\"" << path << "\" exists, use --overwrite to replace it." << endl;
+                return 2;
+            }
+
+    try
+    {
+        mt19937 gen( config.seed );
+        vector<TDataObject> data_objects = generate( config, gen );
+
+        // the queries are centered at random data objects, so they follow the distribution of the data,
+        // the windows are scaled by the MBR of the data
+        vector<double> low( config.dim, DBL_MAX ), high( config.dim, - DBL_MAX );
+        for( const auto & data_object : data_objects )
+            for( uint32_t i = 0 ; i < config.dim ; i++ )
+            {
+                low[i] = min( low[i], get<1>( data_object )[i] );
+                high[i] = max( high[i], get<1>( data_object )[i] + get<2>( data_object )[i] );
+            }
+
+        uniform_int_distribution<size_t> random_object( 0, data_objects.size() - 1 );
+        vector<pair<vector<double>, vector<double>>> windows( config.queries );
+        vector<vector<double>> points( config.queries );
+        for( uint32_t q = 0 ; q < config.queries ; q++ )
+        {
+            const TDataObject & window_center = data_objects[ random_object( gen ) ];
+            const TDataObject & point = data_objects[ random_object( gen ) ];
+            for( uint32_t i = 0 ; i < config.dim ; i++ )
+            {
+                const double side = ( high[i] - low[i] ) * config.window;
+                windows[q].first.push_back( get<1>( window_center )[i] + get<2>( window_center )[i] / 2 - side / 2 );
+                windows[q].second.push_back( side );
+                points[q].push_back( get<1>( point )[i] + get<2>( point )[i] / 2 );
+            }
+        }
+
+        const map<string, CRTree::Insertion> insertions{ { "guttman", CRTree::GUTTMAN }, { "rstar", CRTree::RSTAR }, { "hilbert", CRTree::HILBERT } };
+        const map<string, CSplitStrategy::Algorithm> splits{ { "linear", CSplitStrategy::LINEAR }, { "quadratic", CSplitStrategy::QUADRATIC },
+                                                             { "rstar", CSplitStrategy::RSTAR }, { "angtan", CSplitStrategy::ANG_TAN } };
+        const map<string, CRTree::Encoding> encodings{ { "plain", CRTree::PLAIN }, { "compact", CRTree::COMPACT } };
+        const map<string, CStorage::Backend> backends{ { "stream", CStorage::STREAM }, { "mmap", CStorage::MMAP }, { "direct", CStorage::DIRECT } };
+
+        remove( config.file.c_str() );
+        unique_ptr<CRTree> tree;
+        if( config.page_size )
+            tree.reset( new CRTree( config.file, config.dim, ( CRTree::PageSize ) config.page_size, config.cache_size,
+                                    backends.at( config.backend ), insertions.at( config.insertion ),
+                                    splits.at( config.split ), encodings.at( config.encoding ) ) );
+        else
+            tree.reset( new CRTree( config.file, config.dim, config.min_child_nodes, config.max_child_nodes, config.cache_size, 0,
+                                    backends.at( config.backend ), insertions.at( config.insertion ),
+                                    splits.at( config.split ), encodings.at( config.encoding ) ) );
+
+        vector<CPhase> phases( 3 );
+        chrono::steady_clock::time_point start;
+
+        // load
+        {
+            CPhase & phase = phases[0];
+            tree->resetStats();
+            if( config.load == "bulk" )
+            {
+                phase.name = "bulk_load";
+                list<TDataObject> to_load( data_objects.begin(), data_objects.end() );
+                start = chrono::steady_clock::now();
+                tree->bulkLoad( to_load );
+                phase.seconds.push_back( elapsed( start ) );
+            }
+            else
+            {
+                phase.name = "insert";
+                phase.seconds.reserve( data_objects.size() );
+                for( const auto & data_object : data_objects )
+                {
+                    start = chrono::steady_clock::now();
+                    tree->insert( get<0>( data_object ), get<1>( data_object ), get<2>( data_object ) );
+                    phase.seconds.push_back( elapsed( start ) );
+                }
+            }
+            collect( * tree, phase );
+        }
+
+        // the ids of the results are kept for the comparison
+        vector<vector<uint32_t>> search_ids( windows.size() ), knn_ids( points.size() );
+        {
+            CPhase & phase = phases[1];
+            phase.name = "search";
+            tree->resetStats();
+            for( uint32_t q = 0 ; q < windows.size() ; q++ )
+            {
+                vector<uint32_t> & ids = search_ids[q];
+                start = chrono::steady_clock::now();
+                tree->search( windows[q].first, windows[q].second, [&ids]( const CNode & data_node )
+                {
+                    ids.push_back( data_node.data_object_id() );
+                    return true;
+                } );
+                phase.seconds.push_back( elapsed( start ) );
+                phase.results += ids.size();
+            }
+            collect( * tree, phase );
+        }
+
+        {
+            CPhase & phase = phases[2];
+            phase.name = "knn";
+            tree->resetStats();
+            for( uint32_t q = 0 ; q < points.size() ; q++ )
+            {
+                vector<uint32_t> & ids = knn_ids[q];
+                start = chrono::steady_clock::now();
+                tree->knn( config.k, points[q], [&ids]( const CNode & data_node )
+                {
+                    ids.push_back( data_node.data_object_id() );
+                    return true;
+                } );
+                phase.seconds.push_back( elapsed( start ) );
+                phase.results += ids.size();
+            }
+            collect( * tree, phase );
+        }
+
+        // after the queries, the analysis reads the whole tree through the cache
+        const CQuality quality = tree->analyze( config.window );
+
+        tree.reset();
+        remove( config.file.c_str() );
+
+        // the sequential scan, it stores the data object with id i at the i-th position, so the ids start at 0
+        vector<CPhase> baseline;
+        if( config.baseline_queries )
+        {
+            const uint32_t queries = min( config.queries, config.baseline_queries );
+            CNotRTree scan( config.file + ".scan", config.dim );
+            baseline.resize( 3 );
+
+            baseline[0].name = "insert";
+            for( const auto & data_object : data_objects )
+            {
+                start = chrono::steady_clock::now();
+                scan.insert( get<0>( data_object ) - 1, get<1>( data_object ), get<2>( data_object ) );
+                baseline[0].seconds.push_back( elapsed( start ) );
+                baseline[0].io += scan.lastOpIO();
+            }
+
+            list<TDataObject> results;
+            vector<uint32_t> ids;
+            baseline[1].name = "search";
+            baseline[1].mismatches = 0;
+            for( uint32_t q = 0 ; q < queries ; q++ )
+            {
+                start = chrono::steady_clock::now();
+                results = scan.search( windows[q].first, windows[q].second );
+                baseline[1].seconds.push_back( elapsed( start ) );
+                baseline[1].io += scan.lastOpIO();
+                baseline[1].results += results.size();
+
+                ids.clear();
+                for( const auto & result : results )
+                    ids.push_back( get<0>( result ) + 1 );
+                sort( ids.begin(), ids.end() );
+                sort( search_ids[q].begin(), search_ids[q].end() );
+                baseline[1].mismatches += ids != search_ids[q];
+            }
+
+            baseline[2].name = "knn";
+            baseline[2].mismatches = 0;
+            for( uint32_t q = 0 ; q < queries ; q++ )
+            {
+                start = chrono::steady_clock::now();
+                results = scan.knn( config.k, points[q] );
+                baseline[2].seconds.push_back( elapsed( start ) );
+                baseline[2].io += scan.lastOpIO();
+                baseline[2].results += results.size();
+
+                ids.clear();
+                for( const auto & result : results )
+                    ids.push_back( get<0>( result ) + 1 );
+                baseline[2].mismatches += ! sameNeighbours( ids, knn_ids[q], data_objects, points[q] );
+            }
+        }
+
+        cout << setprecision( 10 );
+        cout << "{\n";
+        cout << "  \"config\": {\n";
+        cout << "    \"data\": \"" << config.data << "\", \"n\": " << config.n << ", \"dim\": " << config.dim << ",\n";
+        cout << "    \"min_child_nodes\": " << config.min_child_nodes << ", \"max_child_nodes\": " << config.max_child_nodes
+             << ", \"cache_size\": " << config.cache_size << ", \"page_size\": " << config.page_size << ",\n";
+        cout << "    \"load\": \"" << config.load << "\", \"insertion\": \"" << config.insertion << "\", \"split\": \"" << config.split
+             << "\", \"encoding\": \"" << config.encoding << "\", \"backend\": \"" << config.backend << "\",\n";
+        cout << "    \"queries\": " << config.queries << ", \"k\": " << config.k << ", \"window\": " << config.window
+             << ", \"size\": " << config.size << ", \"clusters\": " << config.clusters << ", \"seed\": " << config.seed
+             << ", \"baseline_queries\": " << config.baseline_queries << "\n";
+        cout << "  },\n";
+        cout << "  \"rtree\": {\n";
+        printQuality( cout, quality, "    " );
+        cout << ",\n";
+        cout << "    \"phases\": {\n";
+        for( size_t i = 0 ; i < phases.size() ; i++ )
+            printPhase( cout, phases[i], i + 1 == phases.size() );
+        cout << "    }\n";
+        cout << "  }" << ( baseline.empty() ? "\n" : ",\n" );
+        if( ! baseline.empty() )
+        {
+            cout << "  \"baseline\": {\n";
+            cout << "    \"phases\": {\n";
+            for( size_t i = 0 ; i < baseline.size() ; i++ )
+                printPhase( cout, baseline[i], i + 1 == baseline.size() );
+            cout << "    }\n";
+            cout << "  }\n";
+        }
+        cout << "}" << endl;
+
+        if( config.verify && baseline[1].mismatches + baseline[2].mismatches )
+        {
+            cerr << baseline[1].mismatches << " window and " << baseline[2].mismatches << " kNN queries differ from the sequential scan." << endl;
+            return 1;
+        }
+    }
+    catch( const exception & e )
+    {
+        cerr << e.what() << endl;
+        remove( config.file.c_str() );
+        return 1;
+    }
+
+    return 0;
+}
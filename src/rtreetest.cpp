@@ -1,204 +1,150 @@
-#include "rtreetest.h"
+// Regression checks of CRTree run by CTest. Every failed check is printed, the program exits
+// with 1 if any of them failed.
 
-pair<unsigned, unsigned> rTreeTestA( const unsigned dim, const unsigned n, const unsigned k )
-{
-    unsigned time_rt;
-    unsigned time_no_rt;
-
-    string tmp_path1 = "rttmp1.txt";
-    string tmp_path2 = "rttmp2.txt";
-
-    {
-        CRTree t1( tmp_path1, dim, MIN_CHILD_NODES, MAX_CHILD_NODES, CACHE_SIZE, MAX_ERASED );
-        CNotRTree nt1( tmp_path2, dim );
+#include "crtree.h"
 
-        // initialize random generator
-        random_device rd;
-        mt19937 gen( rd() );
-        uniform_real_distribution<> dis( 0, n );
+#include <iostream>
+#include <filesystem>
+#include <cstdio>
+#include <stdexcept>
 
-        // insert data
-        for( uint32_t i = 0 ; i < n ; i++ )
-        {
-            t1.insert( i, vector<double>( dim, i ), vector<double>( dim, 0 ) );
-            nt1.insert( i, vector<double>( dim, i ), vector<double>( dim, 0 ) );
-        }
+using namespace std;
 
-        // create random search area
-        vector<double> start;
-        vector<double> dist;
-        for( unsigned i = 0 ; i < dim ; i++ )
-        {
-            start.push_back( dis( gen ) );
-            dist.push_back( fabs( dis( gen ) ) );
-        }
+static int failures = 0;
 
-        cout << "-----NO-R-TREE-----\n";
-
-        list<tuple<uint32_t, vector<double>, vector<double>>> searched;
-
-        // run timer and search
-        clock_t time_a = clock();
-        if( k == 0 )
-            searched = nt1.search( start, dist );
-        else
-            searched = nt1.knn( k, start );
-        clock_t time_b = clock();
+static void check( const bool condition, const string & what )
+{
+    if( condition )
+        return;
+    cerr << "FAILED: " << what << endl;
+    failures++;
+}
 
-        if ( time_a == ( (clock_t) - 1 ) || time_b == ( (clock_t) - 1 ) )
-            throw runtime_error( "Unable to calculate time" );
-        else
-            time_no_rt = (unsigned)( time_b - time_a );
+static const char * FILE_NAME = "rtreetest.rt";
 
-        // print results
-        cout << "Search result = { ";
-        for( const auto & x : searched )
+// the root of an empty tree does not exist, so kNN must not read it in any format
+static void knnOnEmptyTree()
+{
+    const vector<pair<CStorage::Backend, string>> backends{ { CStorage::STREAM, "stream" }, { CStorage::MMAP, "mmap" },
+                                                            { CStorage::DIRECT, "direct" } };
+    for( const auto & backend : backends )
+        for( const CRTree::PageSize page_size : { CRTree::PACKED, CRTree::PAGE_4K } )
         {
-            cout << get<0>( x );
-            if( & x != & searched.back() )
-                cout << ", ";
+            const string name = backend.second + ( page_size ? " paged" : " packed" );
+            remove( FILE_NAME );
+            try
+            {
+                unique_ptr<CRTree> tree( page_size ? new CRTree( FILE_NAME, 2, page_size, 16, backend.first )
+                                                   : new CRTree( FILE_NAME, 2, 2, 8, 16, 0, backend.first ) );
+
+                bool thrown = false;
+                try
+                {
+                    tree->knn( 3, { 0, 0 } );
+                }
+                catch( const logic_error & )
+                {
+                    thrown = true;
+                }
+                check( thrown, name + ": knn( 3 ) of an empty tree throws logic_error" );
+                check( tree->knn( 0, { 0, 0 } ).empty(), name + ": knn( 0 ) of an empty tree is empty" );
+                check( tree->getCache().size() == 0, name + ": knn of an empty tree caches no node" );
+            }
+            catch( const exception & e )
+            {
+                check( false, name + ": " + e.what() );
+            }
+            remove( FILE_NAME );
         }
-        cout << " }.\n";
-        cout << "Runtime = " << time_no_rt << " milliseconds.\n";
-        cout << nt1.lastOpIO() << " IO operations were required.\n";
-
-
-        cout << "------R-TREE-------\n";
-
-        // run timer and search
-        time_a = clock();
-        if( k == 0 )
-            searched = t1.search( start, dist );
-        else
-            searched = t1.knn( k, start );
-        time_b = clock();
-
-        if ( time_a == ( (clock_t) - 1 ) || time_b == ( (clock_t) - 1 ) )
-            throw runtime_error( "Unable to calculate time" );
-        else
-            time_rt = (unsigned)( time_b - time_a );
+}
 
-        // print results
-        cout << "Search result = { ";
-        for( const auto & x : searched )
-        {
-            cout << get<0>( x );
-            if( & x != & searched.back() )
-                cout << ", ";
-        }
-        cout << " }.\n";
-        cout << "Runtime = " << time_rt << " milliseconds.\n";
-        cout << t1.lastOpIO() << " IO operations were required.\n";
+// The queries read the same nodes after compact, so the moved nodes and their parents keep
+// the quantized MBRs of their children. The trees are reopened to start with an empty cache.
+static void compactKeepsChildBoxes()
+{
+    const vector<pair<vector<double>, vector<double>>> windows = []()
+    {
+        vector<pair<vector<double>, vector<double>>> retval;
+        for( unsigned i = 0 ; i < 100 ; i++ )
+            retval.push_back( make_pair( vector<double>{ ( i * 37 % 100 ) * 10.0, ( i * 61 % 100 ) * 10.0 }, vector<double>{ 15, 15 } ) );
+        return retval;
+    }();
+    auto reads = [&]()
+    {
+        CRTree tree( FILE_NAME );
+        tree.resetStats();
+        for( const auto & window : windows )
+            tree.search( window.first, window.second, []( const CNode & ) { return true; } );
+        return tree.totalStats().reads;
+    };
+
+    remove( FILE_NAME );
+    {
+        CRTree tree( FILE_NAME, 2, 4, 16, 100000, 0, CStorage::STREAM, CRTree::GUTTMAN, CSplitStrategy::QUADRATIC, CRTree::COMPACT );
+        for( uint32_t id = 1 ; id <= 4000 ; id++ )
+            tree.insert( id, { ( id * 7919 % 1000 ) * 1.0, ( id * 104729 % 1000 ) * 1.0 }, { 2, 2 } );
+        for( uint32_t id = 1 ; id <= 4000 ; id += 3 )
+            tree.erase( id );
     }
 
-    remove( tmp_path1.c_str() );
-    remove( tmp_path2.c_str() );
-
-    return make_pair<>( time_no_rt, time_rt );
+    const uint64_t before = reads();
+    size_t free_slots;
+    {
+        CRTree tree( FILE_NAME );
+        free_slots = tree.compact();
+    }
+    check( free_slots == 0, "compact leaves no free slot" );
+    const uint64_t after = reads();
+    check( after <= before, "compact keeps the quantized child MBRs (" + to_string( before ) + " node reads before, "
+                            + to_string( after ) + " after)" );
+    remove( FILE_NAME );
 }
 
-pair<unsigned, unsigned> rTreeTestB( const unsigned dim, const unsigned n, const unsigned k )
+// a read-only tree is analyzed without writing the file and refuses modifications
+static void readOnlyLeavesFile()
 {
-    unsigned time_rt;
-    unsigned time_no_rt;
-
-    string tmp_path1 = "rttmp1.txt";
-    string tmp_path2 = "rttmp2.txt";
-
+    remove( FILE_NAME );
     {
-        CRTree t1( tmp_path1, dim, MIN_CHILD_NODES, MAX_CHILD_NODES, CACHE_SIZE, MAX_ERASED );
-        CNotRTree nt1( tmp_path2, dim );
-
-        // initialize random generator
-        random_device rd;
-        mt19937 gen( rd() );
-        uniform_real_distribution<> dis( -1000, 1000 );
-
-        // insert random data
-        vector<double> start;
-        vector<double> dist;
-        for( uint32_t id = 0 ; id < n ; id++ )
-        {
-            start.clear();
-            dist.clear();
-            for( unsigned i = 0 ; i < dim ; i++ )
-            {
-                start.push_back( dis( gen ) );
-                dist.push_back( fabs( dis( gen ) ) / 2 );
-            }
-            t1.insert( id, start, dist );
-            nt1.insert( id, start, dist );
-        }
-
-        // create random search area
-        start.clear();
-        dist.clear();
-        for( unsigned i = 0 ; i < dim ; i++ )
-        {
-            start.push_back( dis( gen ) );
-            dist.push_back( fabs( dis( gen ) ) );
-        }
-
-        cout << "-----NO-R-TREE-----\n";
-
-        list<tuple<uint32_t, vector<double>, vector<double>>> searched;
-
-        // run timer and search
-        clock_t time_a = clock();
-        if( k == 0 )
-            searched = nt1.search( start, dist );
-        else
-            searched = nt1.knn( k, start );
-        clock_t time_b = clock();
+        CRTree tree( FILE_NAME, 2, 2, 8, 16, 0 );
+        for( uint32_t id = 1 ; id <= 500 ; id++ )
+            tree.insert( id, { ( id * 7919 % 100 ) * 1.0, ( id * 104729 % 100 ) * 1.0 }, { 1, 1 } );
+    }
 
-        if ( time_a == ( (clock_t) - 1 ) || time_b == ( (clock_t) - 1 ) )
-            throw runtime_error( "Unable to calculate time" );
-        else
-            time_no_rt = (unsigned)( time_b - time_a );
+    // save would write the same bytes, but it would still write them
+    const filesystem::file_time_type before = filesystem::last_write_time( FILE_NAME );
+    {
+        CRTree tree( FILE_NAME, CStorage::STREAM, true );
+        tree.analyze();
+        check( tree.knn( 5, { 50, 50 } ).size() == 5, "a read-only tree answers queries" );
 
-        // print results
-        cout << "Search result = { ";
-        for( const auto & x : searched )
+        bool thrown = false;
+        try
         {
-            cout << get<0>( x );
-            if( & x != & searched.back() )
-                cout << ", ";
+            tree.insert( 1000, { 0, 0 }, { 1, 1 } );
         }
-        cout << " }.\n";
-        cout << "Runtime = " << time_no_rt << " milliseconds.\n";
-        cout << nt1.lastOpIO() << " IO operations were required.\n";
-
-
-        cout << "------R-TREE-------\n";
-
-        // run timer and search
-        time_a = clock();
-        if( k == 0 )
-            searched = t1.search( start, dist );
-        else
-            searched = t1.knn( k, start );
-        time_b = clock();
-
-        if ( time_a == ( (clock_t) - 1 ) || time_b == ( (clock_t) - 1 ) )
-            throw runtime_error( "Unable to calculate time" );
-        else
-            time_rt = (unsigned)( time_b - time_a );
-
-        // print results
-        cout << "Search result = { ";
-        for( const auto & x : searched )
+        catch( const logic_error & )
         {
-            cout << get<0>( x );
-            if( & x != & searched.back() )
-                cout << ", ";
+            thrown = true;
         }
-        cout << " }.\n";
-        cout << "Runtime = " << time_rt << " milliseconds.\n";
-        cout << t1.lastOpIO() << " IO operations were required.\n";
+        check( thrown, "insert into a read-only tree throws logic_error" );
     }
+    check( filesystem::last_write_time( FILE_NAME ) == before, "a read-only tree does not write the file" );
+    remove( FILE_NAME );
+}
 
-    remove( tmp_path1.c_str() );
-    remove( tmp_path2.c_str() );
-
-    return make_pair<>( time_no_rt, time_rt );
+int main()
+{
+    try
+    {
+        knnOnEmptyTree();
+        compactKeepsChildBoxes();
+        readOnlyLeavesFile();
+    }
+    catch( const exception & e )
+    {
+        cerr << "FAILED: " << e.what() << endl;
+        failures++;
+    }
+    remove( FILE_NAME );
+    return failures ? 1 : 0;
 }